@@ -3,22 +3,47 @@
 // @version 2021-05-21
 // - wasm implementation, 2x faster than fast chess.js
 // - FRC support
-// - emcc --bind -o ../js/chess-wasm.js chess.cpp -s WASM=1 -Wall -s MODULARIZE=1 -O3 --closure 1
+// - emcc --bind -o ../js/chess-wasm.js chess.cpp -std=c++17 -s WASM=1 -Wall -s MODULARIZE=1 -s ALLOW_MEMORY_GROWTH=1 -O3 --closure 1
+// - native: g++ -o chess chess.cpp -std=c++17 -O3 -Wall -pthread
 
+#ifdef __EMSCRIPTEN__
 #include <emscripten/bind.h>
 #include <emscripten/val.h>
+#endif
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <regex>
 #include <set>
 #include <stdio.h>
-
+#include <string_view>
+#ifndef __EMSCRIPTEN__
+#include <condition_variable>
+#include <fstream>
+#include <thread>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif
+
+#ifdef __EMSCRIPTEN__
 using namespace emscripten;
+#endif
 
 // specific
 #define DELETE(x) {if (x) delete x; x = nullptr;}
 #define DELETE_ARRAY(x) {if (x) delete [] x; x = nullptr;}
+constexpr int       Abs(int a) {return (a >= 0)? a: -a;}
 constexpr int       Max(int a, int b) {return (a >= b)? a: b;}
 constexpr int       Min(int a, int b) {return (a <= b)? a: b;}
 constexpr uint8_t   Max(uint8_t a, uint8_t b) {return (a >= b)? a: b;}
@@ -33,6 +58,7 @@ typedef uint8_t     Square;
 
 // defines
 constexpr Piece     BISHOP = 3;
+constexpr int       BOOK_RANDOM = 781;
 constexpr uint8_t   BITS_CASTLE = 1;
 constexpr uint8_t   BITS_EN_PASSANT = 2;
 constexpr uint8_t   BLACK = 1;
@@ -43,10 +69,22 @@ constexpr uint8_t   COLOR(Piece piece) {return piece >> 3;}
 constexpr char      COLOR_TEXT(uint8_t color) {return (color == 0)? 'w': 'b';}
 constexpr Piece     COLORIZE(uint8_t color, Piece type) {return type + (color << 3);}
 #define DEFAULT_POSITION "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+constexpr int       Distance(int a, int b) {return Max(Abs((a & 15) - (b & 15)), Abs((a >> 4) - (b >> 4)));}
 constexpr Square    EMPTY = 255;
+constexpr int       ENDGAME_MATERIAL = 4016;
 constexpr Square    Filer(Square square) {return square & 15;}
+constexpr uint32_t  EXPLORER_MAGIC = 0x58455054;
+constexpr int       EXPLORER_ROW = 32;
+constexpr int       EXPLORER_SIZE = 8;
+constexpr int       INDEX_BLOCK = 64;
+constexpr int       INDEX_HEADER = 16;
+constexpr uint32_t  INDEX_MAGIC = 0x58495054;
+constexpr int       INFO_SIZE = 14;
+constexpr Bitboard  LIGHT_SQUARES = 0xaa55aa55aa55aa55ull;
 constexpr Piece     KING = 6;
 constexpr Piece     KNIGHT = 2;
+constexpr int       MaterialCount(uint64_t key, Piece piece) {return (key >> (piece << 2)) & 15;}
+constexpr uint64_t  MaterialUnit(Piece piece) {return 1ull << (piece << 2);}
 constexpr uint8_t   MAX_DEPTH = 64;
 constexpr Piece     MoveCapture(Move move) {return (move >> 10) & 7;};
 constexpr uint8_t   MoveFlag(Move move) {return (move >> 13) & 3;};
@@ -55,20 +93,40 @@ constexpr uint8_t   MoveOrder(Move move) {return (move & 1023);};
 constexpr Piece     MovePromote(Move move) {return (move >> 22) & 7;};
 constexpr Square    MoveTo(Move move) {return (move >> 25) & 127;};
 constexpr Piece     NONE = 0;
+constexpr int       PACKED_SIZE = 38;
 constexpr Piece     PAWN = 1;
+constexpr int       PGN_SIZE = 6;
+constexpr int       PLY_CHUNK = 256;
 #define PIECE_LOWER " pnbrqk  pnbrqk"
 #define PIECE_NAMES " PNBRQK  pnbrqk"
 #define PIECE_UPPER " PNBRQK  PNBRQK"
 constexpr Piece     QUEEN = 5;
 constexpr Square    Rank(Square square) {return square >> 4;}
 constexpr Square    RELATIVE_RANK(int color, int square) {return color? 7 - (square >> 4): (square >> 4);}
+constexpr int       REPLAY_SIZE = 8;
 constexpr Piece     ROOK = 4;
+constexpr int       SCALE_NORMAL = 64;
 constexpr int       SCORE_INFINITY = 31001;
+constexpr int       SCORE_KNOWN_WIN = 10000;
 constexpr int       SCORE_MATE = 31000;
 constexpr int       SCORE_MATING = 30001;
 constexpr int       SCORE_NONE = 31002;
+constexpr int       SEEK_INTERVAL = 16;
+constexpr int       STORE_BLOCK = 4096;
+constexpr int       Square64(int square) {return ((square >> 4) << 3) + (square & 7);}
 constexpr Square    SQUARE_A8 = 0;
 constexpr Square    SQUARE_H1 = 119;
+// eval trace terms, 1 value per side
+constexpr int       TRACE_ATTACK = 0;
+constexpr int       TRACE_DEFENSE = 1;
+constexpr int       TRACE_ENDGAME = 2;
+constexpr int       TRACE_KING = 3;
+constexpr int       TRACE_MATERIAL = 4;
+constexpr int       TRACE_MOBILITY = 5;
+constexpr int       TRACE_PAWN = 6;
+constexpr int       TRACE_RATIO = 7;
+constexpr int       TRACE_SCALE = 8;
+constexpr int       TRACE_SIZE = 9;
 constexpr int       TT_SIZE = 65536;
 constexpr Piece     TYPE(Piece piece) {return piece & 7;}
 constexpr uint8_t   WHITE = 0;
@@ -340,8 +398,252 @@ int PIECE_SQUARES[2][8][128] = {
 
 };
 
+// polyglot Random64, see Book::polyglotKey
+// - 12 * 64 pieces, 4 castling, 8 en passant, 1 turn => the books are compatible with other programs
+constexpr Hash POLYGLOT_RANDOMS[BOOK_RANDOM] = {
+    0x9D39247E33776D41ull, 0x2AF7398005AAA5C7ull, 0x44DB015024623547ull, 0x9C15F73E62A76AE2ull,
+    0x75834465489C0C89ull, 0x3290AC3A203001BFull, 0x0FBBAD1F61042279ull, 0xE83A908FF2FB60CAull,
+    0x0D7E765D58755C10ull, 0x1A083822CEAFE02Dull, 0x9605D5F0E25EC3B0ull, 0xD021FF5CD13A2ED5ull,
+    0x40BDF15D4A672E32ull, 0x011355146FD56395ull, 0x5DB4832046F3D9E5ull, 0x239F8B2D7FF719CCull,
+    0x05D1A1AE85B49AA1ull, 0x679F848F6E8FC971ull, 0x7449BBFF801FED0Bull, 0x7D11CDB1C3B7ADF0ull,
+    0x82C7709E781EB7CCull, 0xF3218F1C9510786Cull, 0x331478F3AF51BBE6ull, 0x4BB38DE5E7219443ull,
+    0xAA649C6EBCFD50FCull, 0x8DBD98A352AFD40Bull, 0x87D2074B81D79217ull, 0x19F3C751D3E92AE1ull,
+    0xB4AB30F062B19ABFull, 0x7B0500AC42047AC4ull, 0xC9452CA81A09D85Dull, 0x24AA6C514DA27500ull,
+    0x4C9F34427501B447ull, 0x14A68FD73C910841ull, 0xA71B9B83461CBD93ull, 0x03488B95B0F1850Full,
+    0x637B2B34FF93C040ull, 0x09D1BC9A3DD90A94ull, 0x3575668334A1DD3Bull, 0x735E2B97A4C45A23ull,
+    0x18727070F1BD400Bull, 0x1FCBACD259BF02E7ull, 0xD310A7C2CE9B6555ull, 0xBF983FE0FE5D8244ull,
+    0x9F74D14F7454A824ull, 0x51EBDC4AB9BA3035ull, 0x5C82C505DB9AB0FAull, 0xFCF7FE8A3430B241ull,
+    0x3253A729B9BA3DDEull, 0x8C74C368081B3075ull, 0xB9BC6C87167C33E7ull, 0x7EF48F2B83024E20ull,
+    0x11D505D4C351BD7Full, 0x6568FCA92C76A243ull, 0x4DE0B0F40F32A7B8ull, 0x96D693460CC37E5Dull,
+    0x42E240CB63689F2Full, 0x6D2BDCDAE2919661ull, 0x42880B0236E4D951ull, 0x5F0F4A5898171BB6ull,
+    0x39F890F579F92F88ull, 0x93C5B5F47356388Bull, 0x63DC359D8D231B78ull, 0xEC16CA8AEA98AD76ull,
+    0x5355F900C2A82DC7ull, 0x07FB9F855A997142ull, 0x5093417AA8A7ED5Eull, 0x7BCBC38DA25A7F3Cull,
+    0x19FC8A768CF4B6D4ull, 0x637A7780DECFC0D9ull, 0x8249A47AEE0E41F7ull, 0x79AD695501E7D1E8ull,
+    0x14ACBAF4777D5776ull, 0xF145B6BECCDEA195ull, 0xDABF2AC8201752FCull, 0x24C3C94DF9C8D3F6ull,
+    0xBB6E2924F03912EAull, 0x0CE26C0B95C980D9ull, 0xA49CD132BFBF7CC4ull, 0xE99D662AF4243939ull,
+    0x27E6AD7891165C3Full, 0x8535F040B9744FF1ull, 0x54B3F4FA5F40D873ull, 0x72B12C32127FED2Bull,
+    0xEE954D3C7B411F47ull, 0x9A85AC909A24EAA1ull, 0x70AC4CD9F04F21F5ull, 0xF9B89D3E99A075C2ull,
+    0x87B3E2B2B5C907B1ull, 0xA366E5B8C54F48B8ull, 0xAE4A9346CC3F7CF2ull, 0x1920C04D47267BBDull,
+    0x87BF02C6B49E2AE9ull, 0x092237AC237F3859ull, 0xFF07F64EF8ED14D0ull, 0x8DE8DCA9F03CC54Eull,
+    0x9C1633264DB49C89ull, 0xB3F22C3D0B0B38EDull, 0x390E5FB44D01144Bull, 0x5BFEA5B4712768E9ull,
+    0x1E1032911FA78984ull, 0x9A74ACB964E78CB3ull, 0x4F80F7A035DAFB04ull, 0x6304D09A0B3738C4ull,
+    0x2171E64683023A08ull, 0x5B9B63EB9CEFF80Cull, 0x506AACF489889342ull, 0x1881AFC9A3A701D6ull,
+    0x6503080440750644ull, 0xDFD395339CDBF4A7ull, 0xEF927DBCF00C20F2ull, 0x7B32F7D1E03680ECull,
+    0xB9FD7620E7316243ull, 0x05A7E8A57DB91B77ull, 0xB5889C6E15630A75ull, 0x4A750A09CE9573F7ull,
+    0xCF464CEC899A2F8Aull, 0xF538639CE705B824ull, 0x3C79A0FF5580EF7Full, 0xEDE6C87F8477609Dull,
+    0x799E81F05BC93F31ull, 0x86536B8CF3428A8Cull, 0x97D7374C60087B73ull, 0xA246637CFF328532ull,
+    0x043FCAE60CC0EBA0ull, 0x920E449535DD359Eull, 0x70EB093B15B290CCull, 0x73A1921916591CBDull,
+    0x56436C9FE1A1AA8Dull, 0xEFAC4B70633B8F81ull, 0xBB215798D45DF7AFull, 0x45F20042F24F1768ull,
+    0x930F80F4E8EB7462ull, 0xFF6712FFCFD75EA1ull, 0xAE623FD67468AA70ull, 0xDD2C5BC84BC8D8FCull,
+    0x7EED120D54CF2DD9ull, 0x22FE545401165F1Cull, 0xC91800E98FB99929ull, 0x808BD68E6AC10365ull,
+    0xDEC468145B7605F6ull, 0x1BEDE3A3AEF53302ull, 0x43539603D6C55602ull, 0xAA969B5C691CCB7Aull,
+    0xA87832D392EFEE56ull, 0x65942C7B3C7E11AEull, 0xDED2D633CAD004F6ull, 0x21F08570F420E565ull,
+    0xB415938D7DA94E3Cull, 0x91B859E59ECB6350ull, 0x10CFF333E0ED804Aull, 0x28AED140BE0BB7DDull,
+    0xC5CC1D89724FA456ull, 0x5648F680F11A2741ull, 0x2D255069F0B7DAB3ull, 0x9BC5A38EF729ABD4ull,
+    0xEF2F054308F6A2BCull, 0xAF2042F5CC5C2858ull, 0x480412BAB7F5BE2Aull, 0xAEF3AF4A563DFE43ull,
+    0x19AFE59AE451497Full, 0x52593803DFF1E840ull, 0xF4F076E65F2CE6F0ull, 0x11379625747D5AF3ull,
+    0xBCE5D2248682C115ull, 0x9DA4243DE836994Full, 0x066F70B33FE09017ull, 0x4DC4DE189B671A1Cull,
+    0x51039AB7712457C3ull, 0xC07A3F80C31FB4B4ull, 0xB46EE9C5E64A6E7Cull, 0xB3819A42ABE61C87ull,
+    0x21A007933A522A20ull, 0x2DF16F761598AA4Full, 0x763C4A1371B368FDull, 0xF793C46702E086A0ull,
+    0xD7288E012AEB8D31ull, 0xDE336A2A4BC1C44Bull, 0x0BF692B38D079F23ull, 0x2C604A7A177326B3ull,
+    0x4850E73E03EB6064ull, 0xCFC447F1E53C8E1Bull, 0xB05CA3F564268D99ull, 0x9AE182C8BC9474E8ull,
+    0xA4FC4BD4FC5558CAull, 0xE755178D58FC4E76ull, 0x69B97DB1A4C03DFEull, 0xF9B5B7C4ACC67C96ull,
+    0xFC6A82D64B8655FBull, 0x9C684CB6C4D24417ull, 0x8EC97D2917456ED0ull, 0x6703DF9D2924E97Eull,
+    0xC547F57E42A7444Eull, 0x78E37644E7CAD29Eull, 0xFE9A44E9362F05FAull, 0x08BD35CC38336615ull,
+    0x9315E5EB3A129ACEull, 0x94061B871E04DF75ull, 0xDF1D9F9D784BA010ull, 0x3BBA57B68871B59Dull,
+    0xD2B7ADEEDED1F73Full, 0xF7A255D83BC373F8ull, 0xD7F4F2448C0CEB81ull, 0xD95BE88CD210FFA7ull,
+    0x336F52F8FF4728E7ull, 0xA74049DAC312AC71ull, 0xA2F61BB6E437FDB5ull, 0x4F2A5CB07F6A35B3ull,
+    0x87D380BDA5BF7859ull, 0x16B9F7E06C453A21ull, 0x7BA2484C8A0FD54Eull, 0xF3A678CAD9A2E38Cull,
+    0x39B0BF7DDE437BA2ull, 0xFCAF55C1BF8A4424ull, 0x18FCF680573FA594ull, 0x4C0563B89F495AC3ull,
+    0x40E087931A00930Dull, 0x8CFFA9412EB642C1ull, 0x68CA39053261169Full, 0x7A1EE967D27579E2ull,
+    0x9D1D60E5076F5B6Full, 0x3810E399B6F65BA2ull, 0x32095B6D4AB5F9B1ull, 0x35CAB62109DD038Aull,
+    0xA90B24499FCFAFB1ull, 0x77A225A07CC2C6BDull, 0x513E5E634C70E331ull, 0x4361C0CA3F692F12ull,
+    0xD941ACA44B20A45Bull, 0x528F7C8602C5807Bull, 0x52AB92BEB9613989ull, 0x9D1DFA2EFC557F73ull,
+    0x722FF175F572C348ull, 0x1D1260A51107FE97ull, 0x7A249A57EC0C9BA2ull, 0x04208FE9E8F7F2D6ull,
+    0x5A110C6058B920A0ull, 0x0CD9A497658A5698ull, 0x56FD23C8F9715A4Cull, 0x284C847B9D887AAEull,
+    0x04FEABFBBDB619CBull, 0x742E1E651C60BA83ull, 0x9A9632E65904AD3Cull, 0x881B82A13B51B9E2ull,
+    0x506E6744CD974924ull, 0xB0183DB56FFC6A79ull, 0x0ED9B915C66ED37Eull, 0x5E11E86D5873D484ull,
+    0xF678647E3519AC6Eull, 0x1B85D488D0F20CC5ull, 0xDAB9FE6525D89021ull, 0x0D151D86ADB73615ull,
+    0xA865A54EDCC0F019ull, 0x93C42566AEF98FFBull, 0x99E7AFEABE000731ull, 0x48CBFF086DDF285Aull,
+    0x7F9B6AF1EBF78BAFull, 0x58627E1A149BBA21ull, 0x2CD16E2ABD791E33ull, 0xD363EFF5F0977996ull,
+    0x0CE2A38C344A6EEDull, 0x1A804AADB9CFA741ull, 0x907F30421D78C5DEull, 0x501F65EDB3034D07ull,
+    0x37624AE5A48FA6E9ull, 0x957BAF61700CFF4Eull, 0x3A6C27934E31188Aull, 0xD49503536ABCA345ull,
+    0x088E049589C432E0ull, 0xF943AEE7FEBF21B8ull, 0x6C3B8E3E336139D3ull, 0x364F6FFA464EE52Eull,
+    0xD60F6DCEDC314222ull, 0x56963B0DCA418FC0ull, 0x16F50EDF91E513AFull, 0xEF1955914B609F93ull,
+    0x565601C0364E3228ull, 0xECB53939887E8175ull, 0xBAC7A9A18531294Bull, 0xB344C470397BBA52ull,
+    0x65D34954DAF3CEBDull, 0xB4B81B3FA97511E2ull, 0xB422061193D6F6A7ull, 0x071582401C38434Dull,
+    0x7A13F18BBEDC4FF5ull, 0xBC4097B116C524D2ull, 0x59B97885E2F2EA28ull, 0x99170A5DC3115544ull,
+    0x6F423357E7C6A9F9ull, 0x325928EE6E6F8794ull, 0xD0E4366228B03343ull, 0x565C31F7DE89EA27ull,
+    0x30F5611484119414ull, 0xD873DB391292ED4Full, 0x7BD94E1D8E17DEBCull, 0xC7D9F16864A76E94ull,
+    0x947AE053EE56E63Cull, 0xC8C93882F9475F5Full, 0x3A9BF55BA91F81CAull, 0xD9A11FBB3D9808E4ull,
+    0x0FD22063EDC29FCAull, 0xB3F256D8ACA0B0B9ull, 0xB03031A8B4516E84ull, 0x35DD37D5871448AFull,
+    0xE9F6082B05542E4Eull, 0xEBFAFA33D7254B59ull, 0x9255ABB50D532280ull, 0xB9AB4CE57F2D34F3ull,
+    0x693501D628297551ull, 0xC62C58F97DD949BFull, 0xCD454F8F19C5126Aull, 0xBBE83F4ECC2BDECBull,
+    0xDC842B7E2819E230ull, 0xBA89142E007503B8ull, 0xA3BC941D0A5061CBull, 0xE9F6760E32CD8021ull,
+    0x09C7E552BC76492Full, 0x852F54934DA55CC9ull, 0x8107FCCF064FCF56ull, 0x098954D51FFF6580ull,
+    0x23B70EDB1955C4BFull, 0xC330DE426430F69Dull, 0x4715ED43E8A45C0Aull, 0xA8D7E4DAB780A08Dull,
+    0x0572B974F03CE0BBull, 0xB57D2E985E1419C7ull, 0xE8D9ECBE2CF3D73Full, 0x2FE4B17170E59750ull,
+    0x11317BA87905E790ull, 0x7FBF21EC8A1F45ECull, 0x1725CABFCB045B00ull, 0x964E915CD5E2B207ull,
+    0x3E2B8BCBF016D66Dull, 0xBE7444E39328A0ACull, 0xF85B2B4FBCDE44B7ull, 0x49353FEA39BA63B1ull,
+    0x1DD01AAFCD53486Aull, 0x1FCA8A92FD719F85ull, 0xFC7C95D827357AFAull, 0x18A6A990C8B35EBDull,
+    0xCCCB7005C6B9C28Dull, 0x3BDBB92C43B17F26ull, 0xAA70B5B4F89695A2ull, 0xE94C39A54A98307Full,
+    0xB7A0B174CFF6F36Eull, 0xD4DBA84729AF48ADull, 0x2E18BC1AD9704A68ull, 0x2DE0966DAF2F8B1Cull,
+    0xB9C11D5B1E43A07Eull, 0x64972D68DEE33360ull, 0x94628D38D0C20584ull, 0xDBC0D2B6AB90A559ull,
+    0xD2733C4335C6A72Full, 0x7E75D99D94A70F4Dull, 0x6CED1983376FA72Bull, 0x97FCAACBF030BC24ull,
+    0x7B77497B32503B12ull, 0x8547EDDFB81CCB94ull, 0x79999CDFF70902CBull, 0xCFFE1939438E9B24ull,
+    0x829626E3892D95D7ull, 0x92FAE24291F2B3F1ull, 0x63E22C147B9C3403ull, 0xC678B6D860284A1Cull,
+    0x5873888850659AE7ull, 0x0981DCD296A8736Dull, 0x9F65789A6509A440ull, 0x9FF38FED72E9052Full,
+    0xE479EE5B9930578Cull, 0xE7F28ECD2D49EECDull, 0x56C074A581EA17FEull, 0x5544F7D774B14AEFull,
+    0x7B3F0195FC6F290Full, 0x12153635B2C0CF57ull, 0x7F5126DBBA5E0CA7ull, 0x7A76956C3EAFB413ull,
+    0x3D5774A11D31AB39ull, 0x8A1B083821F40CB4ull, 0x7B4A38E32537DF62ull, 0x950113646D1D6E03ull,
+    0x4DA8979A0041E8A9ull, 0x3BC36E078F7515D7ull, 0x5D0A12F27AD310D1ull, 0x7F9D1A2E1EBE1327ull,
+    0xDA3A361B1C5157B1ull, 0xDCDD7D20903D0C25ull, 0x36833336D068F707ull, 0xCE68341F79893389ull,
+    0xAB9090168DD05F34ull, 0x43954B3252DC25E5ull, 0xB438C2B67F98E5E9ull, 0x10DCD78E3851A492ull,
+    0xDBC27AB5447822BFull, 0x9B3CDB65F82CA382ull, 0xB67B7896167B4C84ull, 0xBFCED1B0048EAC50ull,
+    0xA9119B60369FFEBDull, 0x1FFF7AC80904BF45ull, 0xAC12FB171817EEE7ull, 0xAF08DA9177DDA93Dull,
+    0x1B0CAB936E65C744ull, 0xB559EB1D04E5E932ull, 0xC37B45B3F8D6F2BAull, 0xC3A9DC228CAAC9E9ull,
+    0xF3B8B6675A6507FFull, 0x9FC477DE4ED681DAull, 0x67378D8ECCEF96CBull, 0x6DD856D94D259236ull,
+    0xA319CE15B0B4DB31ull, 0x073973751F12DD5Eull, 0x8A8E849EB32781A5ull, 0xE1925C71285279F5ull,
+    0x74C04BF1790C0EFEull, 0x4DDA48153C94938Aull, 0x9D266D6A1CC0542Cull, 0x7440FB816508C4FEull,
+    0x13328503DF48229Full, 0xD6BF7BAEE43CAC40ull, 0x4838D65F6EF6748Full, 0x1E152328F3318DEAull,
+    0x8F8419A348F296BFull, 0x72C8834A5957B511ull, 0xD7A023A73260B45Cull, 0x94EBC8ABCFB56DAEull,
+    0x9FC10D0F989993E0ull, 0xDE68A2355B93CAE6ull, 0xA44CFE79AE538BBEull, 0x9D1D84FCCE371425ull,
+    0x51D2B1AB2DDFB636ull, 0x2FD7E4B9E72CD38Cull, 0x65CA5B96B7552210ull, 0xDD69A0D8AB3B546Dull,
+    0x604D51B25FBF70E2ull, 0x73AA8A564FB7AC9Eull, 0x1A8C1E992B941148ull, 0xAAC40A2703D9BEA0ull,
+    0x764DBEAE7FA4F3A6ull, 0x1E99B96E70A9BE8Bull, 0x2C5E9DEB57EF4743ull, 0x3A938FEE32D29981ull,
+    0x26E6DB8FFDF5ADFEull, 0x469356C504EC9F9Dull, 0xC8763C5B08D1908Cull, 0x3F6C6AF859D80055ull,
+    0x7F7CC39420A3A545ull, 0x9BFB227EBDF4C5CEull, 0x89039D79D6FC5C5Cull, 0x8FE88B57305E2AB6ull,
+    0xA09E8C8C35AB96DEull, 0xFA7E393983325753ull, 0xD6B6D0ECC617C699ull, 0xDFEA21EA9E7557E3ull,
+    0xB67C1FA481680AF8ull, 0xCA1E3785A9E724E5ull, 0x1CFC8BED0D681639ull, 0xD18D8549D140CAEAull,
+    0x4ED0FE7E9DC91335ull, 0xE4DBF0634473F5D2ull, 0x1761F93A44D5AEFEull, 0x53898E4C3910DA55ull,
+    0x734DE8181F6EC39Aull, 0x2680B122BAA28D97ull, 0x298AF231C85BAFABull, 0x7983EED3740847D5ull,
+    0x66C1A2A1A60CD889ull, 0x9E17E49642A3E4C1ull, 0xEDB454E7BADC0805ull, 0x50B704CAB602C329ull,
+    0x4CC317FB9CDDD023ull, 0x66B4835D9EAFEA22ull, 0x219B97E26FFC81BDull, 0x261E4E4C0A333A9Dull,
+    0x1FE2CCA76517DB90ull, 0xD7504DFA8816EDBBull, 0xB9571FA04DC089C8ull, 0x1DDC0325259B27DEull,
+    0xCF3F4688801EB9AAull, 0xF4F5D05C10CAB243ull, 0x38B6525C21A42B0Eull, 0x36F60E2BA4FA6800ull,
+    0xEB3593803173E0CEull, 0x9C4CD6257C5A3603ull, 0xAF0C317D32ADAA8Aull, 0x258E5A80C7204C4Bull,
+    0x8B889D624D44885Dull, 0xF4D14597E660F855ull, 0xD4347F66EC8941C3ull, 0xE699ED85B0DFB40Dull,
+    0x2472F6207C2D0484ull, 0xC2A1E7B5B459AEB5ull, 0xAB4F6451CC1D45ECull, 0x63767572AE3D6174ull,
+    0xA59E0BD101731A28ull, 0x116D0016CB948F09ull, 0x2CF9C8CA052F6E9Full, 0x0B090A7560A968E3ull,
+    0xABEEDDB2DDE06FF1ull, 0x58EFC10B06A2068Dull, 0xC6E57A78FBD986E0ull, 0x2EAB8CA63CE802D7ull,
+    0x14A195640116F336ull, 0x7C0828DD624EC390ull, 0xD74BBE77E6116AC7ull, 0x804456AF10F5FB53ull,
+    0xEBE9EA2ADF4321C7ull, 0x03219A39EE587A30ull, 0x49787FEF17AF9924ull, 0xA1E9300CD8520548ull,
+    0x5B45E522E4B1B4EFull, 0xB49C3B3995091A36ull, 0xD4490AD526F14431ull, 0x12A8F216AF9418C2ull,
+    0x001F837CC7350524ull, 0x1877B51E57A764D5ull, 0xA2853B80F17F58EEull, 0x993E1DE72D36D310ull,
+    0xB3598080CE64A656ull, 0x252F59CF0D9F04BBull, 0xD23C8E176D113600ull, 0x1BDA0492E7E4586Eull,
+    0x21E0BD5026C619BFull, 0x3B097ADAF088F94Eull, 0x8D14DEDB30BE846Eull, 0xF95CFFA23AF5F6F4ull,
+    0x3871700761B3F743ull, 0xCA672B91E9E4FA16ull, 0x64C8E531BFF53B55ull, 0x241260ED4AD1E87Dull,
+    0x106C09B972D2E822ull, 0x7FBA195410E5CA30ull, 0x7884D9BC6CB569D8ull, 0x0647DFEDCD894A29ull,
+    0x63573FF03E224774ull, 0x4FC8E9560F91B123ull, 0x1DB956E450275779ull, 0xB8D91274B9E9D4FBull,
+    0xA2EBEE47E2FBFCE1ull, 0xD9F1F30CCD97FB09ull, 0xEFED53D75FD64E6Bull, 0x2E6D02C36017F67Full,
+    0xA9AA4D20DB084E9Bull, 0xB64BE8D8B25396C1ull, 0x70CB6AF7C2D5BCF0ull, 0x98F076A4F7A2322Eull,
+    0xBF84470805E69B5Full, 0x94C3251F06F90CF3ull, 0x3E003E616A6591E9ull, 0xB925A6CD0421AFF3ull,
+    0x61BDD1307C66E300ull, 0xBF8D5108E27E0D48ull, 0x240AB57A8B888B20ull, 0xFC87614BAF287E07ull,
+    0xEF02CDD06FFDB432ull, 0xA1082C0466DF6C0Aull, 0x8215E577001332C8ull, 0xD39BB9C3A48DB6CFull,
+    0x2738259634305C14ull, 0x61CF4F94C97DF93Dull, 0x1B6BACA2AE4E125Bull, 0x758F450C88572E0Bull,
+    0x959F587D507A8359ull, 0xB063E962E045F54Dull, 0x60E8ED72C0DFF5D1ull, 0x7B64978555326F9Full,
+    0xFD080D236DA814BAull, 0x8C90FD9B083F4558ull, 0x106F72FE81E2C590ull, 0x7976033A39F7D952ull,
+    0xA4EC0132764CA04Bull, 0x733EA705FAE4FA77ull, 0xB4D8F77BC3E56167ull, 0x9E21F4F903B33FD9ull,
+    0x9D765E419FB69F6Dull, 0xD30C088BA61EA5EFull, 0x5D94337FBFAF7F5Bull, 0x1A4E4822EB4D7A59ull,
+    0x6FFE73E81B637FB3ull, 0xDDF957BC36D8B9CAull, 0x64D0E29EEA8838B3ull, 0x08DD9BDFD96B9F63ull,
+    0x087E79E5A57D1D13ull, 0xE328E230E3E2B3FBull, 0x1C2559E30F0946BEull, 0x720BF5F26F4D2EAAull,
+    0xB0774D261CC609DBull, 0x443F64EC5A371195ull, 0x4112CF68649A260Eull, 0xD813F2FAB7F5C5CAull,
+    0x660D3257380841EEull, 0x59AC2C7873F910A3ull, 0xE846963877671A17ull, 0x93B633ABFA3469F8ull,
+    0xC0C0F5A60EF4CDCFull, 0xCAF21ECD4377B28Cull, 0x57277707199B8175ull, 0x506C11B9D90E8B1Dull,
+    0xD83CC2687A19255Full, 0x4A29C6465A314CD1ull, 0xED2DF21216235097ull, 0xB5635C95FF7296E2ull,
+    0x22AF003AB672E811ull, 0x52E762596BF68235ull, 0x9AEBA33AC6ECC6B0ull, 0x944F6DE09134DFB6ull,
+    0x6C47BEC883A7DE39ull, 0x6AD047C430A12104ull, 0xA5B1CFDBA0AB4067ull, 0x7C45D833AFF07862ull,
+    0x5092EF950A16DA0Bull, 0x9338E69C052B8E7Bull, 0x455A4B4CFE30E3F5ull, 0x6B02E63195AD0CF8ull,
+    0x6B17B224BAD6BF27ull, 0xD1E0CCD25BB9C169ull, 0xDE0C89A556B9AE70ull, 0x50065E535A213CF6ull,
+    0x9C1169FA2777B874ull, 0x78EDEFD694AF1EEDull, 0x6DC93D9526A50E68ull, 0xEE97F453F06791EDull,
+    0x32AB0EDB696703D3ull, 0x3A6853C7E70757A7ull, 0x31865CED6120F37Dull, 0x67FEF95D92607890ull,
+    0x1F2B1D1F15F6DC9Cull, 0xB69E38A8965C6B65ull, 0xAA9119FF184CCCF4ull, 0xF43C732873F24C13ull,
+    0xFB4A3D794A9A80D2ull, 0x3550C2321FD6109Cull, 0x371F77E76BB8417Eull, 0x6BFA9AAE5EC05779ull,
+    0xCD04F3FF001A4778ull, 0xE3273522064480CAull, 0x9F91508BFFCFC14Aull, 0x049A7F41061A9E60ull,
+    0xFCB6BE43A9F2FE9Bull, 0x08DE8A1C7797DA9Bull, 0x8F9887E6078735A1ull, 0xB5B4071DBFC73A66ull,
+    0x230E343DFBA08D33ull, 0x43ED7F5A0FAE657Dull, 0x3A88A0FBBCB05C63ull, 0x21874B8B4D2DBC4Full,
+    0x1BDEA12E35F6A8C9ull, 0x53C065C6C8E63528ull, 0xE34A1D250E7A8D6Bull, 0xD6B04D3B7651DD7Eull,
+    0x5E90277E7CB39E2Dull, 0x2C046F22062DC67Dull, 0xB10BB459132D0A26ull, 0x3FA9DDFB67E2F199ull,
+    0x0E09B88E1914F7AFull, 0x10E8B35AF3EEAB37ull, 0x9EEDECA8E272B933ull, 0xD4C718BC4AE8AE5Full,
+    0x81536D601170FC20ull, 0x91B534F885818A06ull, 0xEC8177F83F900978ull, 0x190E714FADA5156Eull,
+    0xB592BF39B0364963ull, 0x89C350C893AE7DC1ull, 0xAC042E70F8B383F2ull, 0xB49B52E587A1EE60ull,
+    0xFB152FE3FF26DA89ull, 0x3E666E6F69AE2C15ull, 0x3B544EBE544C19F9ull, 0xE805A1E290CF2456ull,
+    0x24B33C9D7ED25117ull, 0xE74733427B72F0C1ull, 0x0A804D18B7097475ull, 0x57E3306D881EDB4Full,
+    0x4AE7D6A36EB5DBCBull, 0x2D8D5432157064C8ull, 0xD1E649DE1E7F268Bull, 0x8A328A1CEDFE552Cull,
+    0x07A3AEC79624C7DAull, 0x84547DDC3E203C94ull, 0x990A98FD5071D263ull, 0x1A4FF12616EEFC89ull,
+    0xF6F7FD1431714200ull, 0x30C05B1BA332F41Cull, 0x8D2636B81555A786ull, 0x46C9FEB55D120902ull,
+    0xCCEC0A73B49C9921ull, 0x4E9D2827355FC492ull, 0x19EBB029435DCB0Full, 0x4659D2B743848A2Cull,
+    0x963EF2C96B33BE31ull, 0x74F85198B05A2E7Dull, 0x5A0F544DD2B1FB18ull, 0x03727073C2E134B1ull,
+    0xC7F6AA2DE59AEA61ull, 0x352787BAA0D7C22Full, 0x9853EAB63B5E0B35ull, 0xABBDCDD7ED5C0860ull,
+    0xCF05DAF5AC8D77B0ull, 0x49CAD48CEBF4A71Eull, 0x7A4C10EC2158C4A6ull, 0xD9E92AA246BF719Eull,
+    0x13AE978D09FE5556ull, 0x730499AF921549FFull, 0x4E4B705B92903BA4ull, 0xFF577222C14F0A3Aull,
+    0x55B6344CF97AAFAEull, 0xB862225B055B6960ull, 0xCAC09AFBDDD2CDB4ull, 0xDAF8E9829FE96B5Full,
+    0xB5FDFC5D3132C498ull, 0x310CB380DB6F7503ull, 0xE87FBB46217A360Eull, 0x2102AE466EBB1148ull,
+    0xF8549E1A3AA5E00Dull, 0x07A69AFDCC42261Aull, 0xC4C118BFE78FEAAEull, 0xF9F4892ED96BD438ull,
+    0x1AF3DBE25D8F45DAull, 0xF5B4B0B0D2DEEEB4ull, 0x962ACEEFA82E1C84ull, 0x046E3ECAAF453CE9ull,
+    0xF05D129681949A4Cull, 0x964781CE734B3C84ull, 0x9C2ED44081CE5FBDull, 0x522E23F3925E319Eull,
+    0x177E00F9FC32F791ull, 0x2BC60A63A6F3B3F2ull, 0x222BBFAE61725606ull, 0x486289DDCC3D6780ull,
+    0x7DC7785B8EFDFC80ull, 0x8AF38731C02BA980ull, 0x1FAB64EA29A2DDF7ull, 0xE4D9429322CD065Aull,
+    0x9DA058C67844F20Cull, 0x24C0E332B70019B0ull, 0x233003B5A6CFE6ADull, 0xD586BD01C5C217F6ull,
+    0x5E5637885F29BC2Bull, 0x7EBA726D8C94094Bull, 0x0A56A5F0BFE39272ull, 0xD79476A84EE20D06ull,
+    0x9E4C1269BAA4BF37ull, 0x17EFEE45B0DEE640ull, 0x1D95B0A5FCF90BC6ull, 0x93CBE0B699C2585Dull,
+    0x65FA4F227A2B6D79ull, 0xD5F9E858292504D5ull, 0xC2B5A03F71471A6Full, 0x59300222B4561E00ull,
+    0xCE2F8642CA0712DCull, 0x7CA9723FBB2E8988ull, 0x2785338347F2BA08ull, 0xC61BB3A141E50E8Cull,
+    0x150F361DAB9DEC26ull, 0x9F6A419D382595F4ull, 0x64A53DC924FE7AC9ull, 0x142DE49FFF7A7C3Dull,
+    0x0C335248857FA9E7ull, 0x0A9C32D5EAE45305ull, 0xE6C42178C4BBB92Eull, 0x71F1CE2490D20B07ull,
+    0xF1BCC3D275AFE51Aull, 0xE728E8C83C334074ull, 0x96FBF83A12884624ull, 0x81A1549FD6573DA5ull,
+    0x5FA7867CAF35E149ull, 0x56986E2EF3ED091Bull, 0x917F1DD5F8886C61ull, 0xD20D8C88C8FFE65Full,
+    0x31D71DCE64B2C310ull, 0xF165B587DF898190ull, 0xA57E6339DD2CF3A1ull, 0x1EF6E6DBB1961EC9ull,
+    0x70CC73D90BC26E24ull, 0xE21A6B35DF0C3AD7ull, 0x003A93D8B2806962ull, 0x1C99DED33CB890A1ull,
+    0xCF3145DE0ADD4289ull, 0xD0E4427A5514FB72ull, 0x77C621CC9FB3A483ull, 0x67A34DAC4356550Bull,
+    0xF8D626AAAF278509ull,
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+class Chess;
+typedef int (Chess::*EndgameFunc)(uint8_t strong);
+
+// strong side (white) + 1 or 2 pieces vs bare king
+struct Bitbase {
+    std::vector<uint8_t> bits;  // 1 bit per state: the strong side wins
+    int     counts[4];          // number of squares: strong king, weak king, pieces
+    int     num_type;           // 1 or 2
+    bool    pawns;              // pawns => only the files are mirrored
+    int     size;               // number of states: 2 * counts
+    Piece   types[2];           // QRBNP order
+};
+
+// polyglot book entry, see Book::build
+struct BookEntry {
+    Hash    key;
+    uint16_t move;
+    uint32_t weight;        // 2 per win + 1 per draw, scaled to 16 bits when written
+
+    bool operator<(const BookEntry &other) const {
+        return (key != other.key)? key < other.key: move < other.move;
+    }
+};
+
+struct Endgame {
+    EndgameFunc func;       // returns a score for the strong side, or a scale factor
+    bool    scale;          // func returns a scale factor instead of a score
+    uint8_t strong;         // strong color
+};
+
+// opening explorer row: statistics of 1 move from 1 position, see Explorer::build for the packed form
+struct Explore {
+    Hash    hash;           // openingKey before the move
+    uint32_t move;          // from + (to << 8) + (promote << 16)
+    int32_t counts[4];      // games, white wins, draws, black wins
+    int32_t num_eval;
+    double  sum_eval;       // white point of view, in pawns
+
+    bool operator<(const Explore &other) const {
+        return (hash != other.hash)? hash < other.hash: move < other.move;
+    }
+};
+
 struct MoveText {
     Piece   capture;
     std::string fen;
@@ -371,6 +673,30 @@ struct MoveText {
     }
 };
 
+struct Posting {
+    Hash    hash;           // openingKey
+    int32_t game;
+    int32_t ply;
+
+    bool operator<(const Posting &other) const {
+        if (hash != other.hash)
+            return hash < other.hash;
+        if (game != other.game)
+            return game < other.game;
+        return ply < other.ply;
+    }
+};
+
+// 1 condition of a store query, see Store::query
+struct Predicate {
+    int     field;          // 0:piece count, 1:piece on mask, 2:material, 3:eval, 4:ply, 5:game, 6:opposite bishops
+    bool    negate;
+    int     op;             // 0:=, 1:!=, 2:<, 3:<=, 4:>, 5:>=
+    Piece   piece;
+    Bitboard mask;          // squares or material_key
+    double  value;
+};
+
 struct PV {
     int     length;
     Move    moves[MAX_DEPTH];
@@ -380,14 +706,27 @@ struct PV {
     }
 };
 
+// undo record of a move, the hash is in Chess::ply_hashes
 struct State {
-    Hash    hash;           // 64 bit
     Square  castling[4];    // 32
     Square  ep_square;      // 8
     uint8_t half_moves;     // 8
     Move    move;           // 32
 };
 
+// node of the variation tree, see Tree::add
+struct TreeNode {
+    Hash    hash;           // board_hash after the move
+    Move    move;           // 0 for the root
+    int32_t child;          // first child, -1 if none
+    int32_t parent;         // -1 for the root
+    int32_t ply;
+    int32_t sibling;        // next child of the parent, -1 if none
+    int32_t text;           // SAN then UCI in Tree::text
+    uint8_t san_size;
+    uint8_t uci_size;
+};
+
 struct Table {
     Hash    hash;           // 64 bit
     int16_t score;          // 16
@@ -406,15 +745,135 @@ MoveText NULL_OBJ = {
     0,
 };
 
+// generated bitbases, shared by all instances + threads
+std::map<std::string, Bitbase> BITBASES;
+std::recursive_mutex BITBASE_MUTEX;
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Index of a position in a bitbase
+ * - the files are mirrored to get the strong king on a-d
+ * - pawnless: the ranks are also mirrored to get the strong king on 8-5
+ * @param bitbase
+ * @param squares strong king, weak king, then the pieces, the strong side is white
+ * @param stm 0 if the strong side is to move
+ * @return index
+ */
+int bitbaseIndex(const Bitbase &bitbase, const Square *squares, int stm) {
+    auto king = squares[0];
+    int flip = ((Filer(king) >= 4)? 7: 0) | ((!bitbase.pawns && Rank(king) >= 4)? 0x70: 0),
+        index = 0;
+
+    for (auto i = bitbase.num_type - 1; i >= 0; i --) {
+        auto square = squares[i + 2] ^ flip;
+        auto rank = Rank(square) - ((bitbase.types[i] == PAWN)? 1: 0);
+        index = index * bitbase.counts[i + 2] + (rank << 3) + Filer(square);
+    }
+    auto king2 = squares[1] ^ flip;
+    index = (index << 6) + (Rank(king2) << 3) + Filer(king2);
+    king ^= flip;
+    index = index * bitbase.counts[0] + (Rank(king) << 2) + Filer(king);
+    return (index << 1) + stm;
+}
+
+/**
+ * Squares of a bitbase index, the reverse of bitbaseIndex
+ * @param bitbase
+ * @param index
+ * @param squares output: strong king, weak king, then the pieces
+ * @return stm
+ */
+int bitbaseSquares(const Bitbase &bitbase, int index, Square *squares) {
+    auto stm = index & 1;
+    index >>= 1;
+
+    auto code = index % bitbase.counts[0];
+    index /= bitbase.counts[0];
+    squares[0] = ((code >> 2) << 4) + (code & 3);
+    code = index & 63;
+    index >>= 6;
+    squares[1] = ((code >> 3) << 4) + (code & 7);
+
+    for (auto i = 0; i < bitbase.num_type; i ++) {
+        code = index % bitbase.counts[i + 2];
+        index /= bitbase.counts[i + 2];
+        auto rank = (code >> 3) + ((bitbase.types[i] == PAWN)? 1: 0);
+        squares[i + 2] = (rank << 4) + (code & 7);
+    }
+    return stm;
+}
+
+/**
+ * Piece of a letter, the map is only read => safe to call from several threads
+ * @param letter P, n, ...
+ * @returns piece, 0 if unknown
+ */
+Piece pieceCode(char letter) {
+    auto it = PIECES.find(letter);
+    return (it != PIECES.end())? it->second: 0;
+}
+
+/**
+ * Read a little endian integer
+ * @param data
+ * @param size number of bytes: 4 or 8
+ * @returns value
+ */
+uint64_t readLittle(const uint8_t *data, int size) {
+    uint64_t value = 0;
+    for (auto i = size - 1; i >= 0; i --)
+        value = (value << 8) | data[i];
+    return value;
+}
+
+/**
+ * Read a LEB128 varint
+ * @param ptr moved after the varint
+ * @param end
+ * @returns value
+ */
+uint64_t readVarint(const uint8_t *&ptr, const uint8_t *end) {
+    uint64_t value = 0;
+    for (auto shift = 0; ptr < end && shift < 64; shift += 7) {
+        auto byte = *ptr ++;
+        value |= (uint64_t)(byte & 127) << shift;
+        if (!(byte & 128))
+            break;
+    }
+    return value;
+}
+
+/**
+ * Write a little endian integer
+ * @param data output
+ * @param value
+ * @param size number of bytes: 4 or 8
+ */
+void writeLittle(std::string &data, uint64_t value, int size) {
+    for (auto i = 0; i < size; i ++, value >>= 8)
+        data += (char)(value & 255);
+}
+
+/**
+ * Write a LEB128 varint: 7 bits per byte, &128 => more bytes
+ * @param data output
+ * @param value
+ */
+void writeVarint(std::string &data, uint64_t value) {
+    while (value >= 128) {
+        data += (char)((value & 127) | 128);
+        value >>= 7;
+    }
+    data += (char)value;
+}
+
 /**
  * 64bit pseudo random generator
  * https://en.wikipedia.org/wiki/Xorshift
  * + WeissNNUE
  */
-Hash xorshift64() {
-    static Hash seed = 1070372ull;
+Hash xorshift64(Hash &seed) {
     seed ^= seed >> 12;
     seed ^= seed << 25;
     seed ^= seed >> 27;
@@ -425,28 +884,67 @@ Hash xorshift64() {
 
 // chess class
 class Chess {
+    // the archives replay their games on the board of a Chess instance
+    friend class Archive;
+    friend class Book;
+    friend class Eco;
+    friend class Explorer;
+    friend class Index;
+    friend class Seeker;
+    friend class Store;
+    friend class Tree;
+
 private:
     // PRIVATE
     //////////
 
+    std::vector<int> agree_cache;               // agree length per ply, -2 if it must be computed
+    bool        agree_hash;                     // compare the positions instead of the moves
+    std::vector<std::vector<Hash>> agree_keys[2];   // move or position keys of the PV of each ply, per side
+    int         agree_offset;
+    uint8_t     attack_map[2][64];              // number of attackers per color + square, a8 = 0
+    bool        attack_ready;                   // attack_map is up to date, else computed on demand
+    bool        attack_track;                   // makeMove + undoMove update attack_map, see trackAttacks
     uint8_t     attacks[16];
     int         avg_depth;
+    std::vector<int> batch_scores;
+    std::vector<Chess *> batch_workers;         // 1 instance per thread, kept between the evaluateBatch calls
+    std::map<uint64_t, Bitbase *> bitbase_cache;    // material_key => bitbase, see prepareBitbases
+    int         bitbase_mode;                   // 0:off, 1:generate up to 3 pieces, 2:up to 4 pieces
     Piece       board[128];
     Hash        board_hash;
     Square      castling[4];
+    std::vector<int32_t> comment_depths;        // columns of parseComments, 1 row per comment
+    std::vector<float> comment_evals;
+    std::vector<double> comment_nodes;
+    std::vector<int32_t> comment_plies;
+    std::vector<int32_t> comment_pvs;           // 3 values per row: start + end in comment_text, legal moves
+    std::vector<int32_t> comment_sel_depths;
+    std::vector<double> comment_speeds;
+    std::vector<double> comment_tbhits;
+    std::string comment_text;
+    std::vector<int32_t> comment_time_lefts;
+    std::vector<int32_t> comment_times;
     int         debug;
     uint8_t     defenses[16];
+    std::map<uint64_t, Endgame> endgames;       // material_key => specialized evaluator
     Square      ep_square;
     int         eval_mode;                      // 0:null, &1:mat, &2:hc2, &4:qui, &8:nn
     std::string fen;
+    uint8_t     fen_dirty;                      // ranks to rebuild in fen_ranks, bit 0 = 8th rank
     int         fen_ply;
+    std::string fen_ranks[8];                   // cached FEN placement per rank, see createFen
     std::vector<Move> first_moves;              // top level moves
     std::vector<MoveText> first_objs;
     bool        frc;
+    std::vector<int32_t> game_columns;          // eval, depth, time per move, see decodeGame
+    std::string game_data;                      // see em_encodeGame
     uint8_t     half_moves;
     int         hash_mode;
+    std::vector<double> info_records;           // INFO_SIZE values per info line, see parseInfos
     bool        is_search;
     Square      kings[4];
+    uint64_t    material_key;                   // 4 bits per piece: count << (piece * 4)
     int         materials[2];
     int         max_depth;
     int         max_extend;
@@ -458,18 +956,35 @@ private:
     int         move_number;
     int         nodes;
     int         order_mode;
+    std::string packed_position;
     Square      pawns[8];
+    std::string pgn_buffer;                     // incomplete line of the previous chunk
+    bool        pgn_comment;                    // inside {...}
+    bool        pgn_create_fen;
+    int         pgn_depth;                      // variation depth
+    std::vector<float> pgn_evals;               // wv= of the comment after each move, NAN if missing
+    std::string pgn_fen;                        // FEN header of the current game
+    int32_t     pgn_game[PGN_SIZE];             // current game, see pgnEnd
+    std::vector<int32_t> pgn_games;             // PGN_SIZE values per finished game
+    int         pgn_state;                      // 0:between games, 1:headers, 2:moves
     Square      pieces[2][16];
     int         ply;
-    State       ply_states[128];
+    std::vector<Hash> ply_hashes;               // board_hash before each move => past positions: [0, ply)
+    std::vector<State> ply_states;              // undo record of each move, grown by PLY_CHUNK and kept across loads
     int         positions[2];
     int         pv_mode;
     std::vector<std::string> prev_pv;
+    std::vector<int32_t> replay_moves;          // REPLAY_SIZE values per move, see addReplay
+    std::string replay_text;                    // SAN + FEN arena for replay_moves
     bool        scan_all;
     int         search_mode;                    // 1:minimax, 2:alpha-beta
     int         sel_depth;
     Table       table[TT_SIZE];                 // 16 bytes: hash=8, score=2, bound=1, depth=1, move=4
-    std::string trace;
+    int         trace[TRACE_SIZE][2];           // eval terms per side, see evaluateTrace
+    std::string track_fen;                      // root of the tracked PV, see trackPv
+    std::vector<MoveText> track_objs;           // converted moves of the tracked PV
+    int         track_prefix;                   // moves kept from the previous PV
+    std::vector<std::string> track_ucis;        // UCI of track_objs
     int         tt_adds;
     int         tt_hits;
     int         turn;
@@ -477,22 +992,30 @@ private:
     bool        zobrist_ready;
     Hash        zobrist_side;
 
+    /**
+     * Register a specialized endgame for both colors
+     * @param code KBNK: strong pieces first, then the weak pieces
+     * @param func evaluator or scaler
+     * @param scale func returns a scale factor
+     */
+    void addEndgame(std::string code, EndgameFunc func, bool scale) {
+        auto second = code.find('K', 1);
+        for (uint8_t strong = 0; strong < 2; strong ++) {
+            uint64_t key = 0;
+            for (size_t i = 0; i < code.size(); i ++) {
+                auto type = TYPE(pieceCode(code[i]));
+                if (type != KING)
+                    key += MaterialUnit(COLORIZE((i < second)? strong: strong ^ 1, type));
+            }
+            endgames[key] = {func, scale, strong};
+        }
+    }
+
     /**
      * Add a single move
      */
     void addMove(std::vector<Move> &moves, Piece piece, Square from, Square to, uint8_t flag, Piece promote, Piece value) {
-        int capture = (flag & BITS_EN_PASSANT)? PAWN: (flag & BITS_CASTLE? NONE: TYPE(value));
-        auto score = (capture | promote)? Max(PIECE_CAPTURES[capture], PIECE_CAPTURES[promote]) - (PIECE_CAPTURES[piece] >> 3) + 50: 0;
-        auto squares = PIECE_SQUARES[COLOR(piece)][TYPE(piece)];
-
-        moves.push_back(
-            100 + squares[to] - squares[from] + (flag & BITS_CASTLE) * 30 + score
-            + (capture << 10)
-            + (flag << 13)
-            + ((from & 127) << 15)
-            + (promote << 22)
-            + ((to & 127) << 25)
-        );
+        moves.push_back(encodeMove(piece, from, to, flag, promote, value));
 
         if (!promote) {
             // TODO:
@@ -518,12 +1041,38 @@ private:
             addMove(moves, piece, from, to, flag, 0, value);
     }
 
+    /**
+     * Add a played move to the replay buffers
+     * - replay_moves: from, to, flag, capture, promote, ply, SAN offset, FEN offset
+     * - replay_text: SAN then FEN, the FEN ends where the SAN of the next move starts
+     */
+    void addReplay(MoveText &obj, bool create_fen) {
+        replay_moves.insert(replay_moves.end(), {
+            obj.from,
+            obj.to,
+            obj.flag,
+            obj.capture,
+            obj.promote,
+            fen_ply + ply,
+            static_cast<int32_t>(replay_text.size()),
+            static_cast<int32_t>(replay_text.size() + obj.m.size()),
+        });
+        replay_text += obj.m;
+        if (create_fen)
+            replay_text += createFen();
+    }
+
     /**
      * Add a ply state
      */
     void addState(Move move) {
-        auto &state = ply_states[ply & 127];
-        state.hash = board_hash;
+        if (ply >= (int)ply_states.size()) {
+            auto size = ply_states.size() + PLY_CHUNK;
+            ply_hashes.resize(size);
+            ply_states.resize(size);
+        }
+        ply_hashes[ply] = board_hash;
+        auto &state = ply_states[ply];
         memcpy(state.castling, castling, sizeof(castling));
         state.ep_square = ep_square;
         state.half_moves = half_moves;
@@ -673,6 +1222,344 @@ private:
         return best;
     }
 
+    /**
+     * Add or remove the attacks of the piece on a square
+     * @param square
+     * @param delta +1 or -1
+     */
+    void attackPiece(Square square, int delta) {
+        auto piece = board[square];
+        auto map = attack_map[COLOR(piece)];
+        auto piece_type = TYPE(piece);
+
+        if (piece_type == PAWN) {
+            for (auto k = 0; k < 3; k += 2) {
+                int pos = square + PAWN_OFFSETS[COLOR(piece)][k];
+                if (!(pos & 0x88))
+                    map[Square64(pos)] += delta;
+            }
+            return;
+        }
+
+        auto slide = (piece_type >= BISHOP && piece_type <= QUEEN);
+        for (auto &offset : PIECE_OFFSETS[piece_type]) {
+            if (!offset)
+                break;
+            for (auto pos = square + offset; !(pos & 0x88); pos += offset) {
+                map[Square64(pos)] += delta;
+                if (board[pos] || !slide)
+                    break;
+            }
+        }
+    }
+
+    /**
+     * Put a piece on an empty square, and update the attack map
+     */
+    void attackPut(Square square, Piece piece) {
+        attackRay(square, -1);
+        board[square] = piece;
+        attackPiece(square, 1);
+    }
+
+    /**
+     * Slider rays going through an empty square: extend them (+1) or block them (-1)
+     * @param square
+     * @param delta
+     */
+    void attackRay(Square square, int delta) {
+        auto offsets = PIECE_OFFSETS[QUEEN];
+        for (auto j = 0; j < 8; j ++) {
+            auto offset = offsets[j];
+            auto pos = square - offset;
+            while (!(pos & 0x88) && !board[pos])
+                pos -= offset;
+            if (pos & 0x88)
+                continue;
+
+            auto piece = board[pos];
+            auto piece_type = TYPE(piece);
+            if (piece_type != QUEEN && piece_type != BISHOP + (j & 1))
+                continue;
+
+            auto map = attack_map[COLOR(piece)];
+            for (pos = square + offset; !(pos & 0x88); pos += offset) {
+                map[Square64(pos)] += delta;
+                if (board[pos])
+                    break;
+            }
+        }
+    }
+
+    /**
+     * Remove the piece of a square, and update the attack map
+     */
+    void attackRemove(Square square) {
+        attackPiece(square, -1);
+        board[square] = 0;
+        attackRay(square, 1);
+    }
+
+    /**
+     * Moves of one side on a bitbase board: no castle, no en passant, the weak side is a bare king
+     * @param color
+     * @param squares pieces of the color
+     * @param count number of pieces
+     * @param backward un-moves: no capture, no promotion, the pawns go backwards
+     * @param moves output
+     */
+    void bitbaseMoves(uint8_t color, const Square *squares, int count, bool backward, std::vector<Move> &moves) {
+        moves.clear();
+
+        for (auto i = 0; i < count; i ++) {
+            int from = squares[i];
+            auto piece_type = TYPE(board[from]);
+
+            // pawn: only pushes, there is nothing to capture
+            if (piece_type == PAWN) {
+                auto offset = backward? -PAWN_OFFSETS[color][1]: PAWN_OFFSETS[color][1];
+                auto to = from + offset;
+                if ((to & 0x88) || board[to])
+                    continue;
+
+                auto rank = RELATIVE_RANK(color, to);
+                if (backward) {
+                    if (rank == 7)
+                        continue;
+                    moves.push_back((from << 15) + (to << 25));
+                    if (rank == 5 && !board[to + offset])
+                        moves.push_back((from << 15) + ((to + offset) << 25));
+                }
+                else if (!rank) {
+                    for (auto promote = QUEEN; promote >= KNIGHT; promote --)
+                        moves.push_back((from << 15) + (promote << 22) + (to << 25));
+                }
+                else {
+                    moves.push_back((from << 15) + (to << 25));
+                    if (rank == 5 && !board[to + offset])
+                        moves.push_back((from << 15) + ((to + offset) << 25));
+                }
+                continue;
+            }
+
+            auto slide = (piece_type >= BISHOP && piece_type <= QUEEN);
+            for (auto &offset : PIECE_OFFSETS[piece_type]) {
+                if (!offset)
+                    break;
+                for (auto to = from + offset; !(to & 0x88); to += offset) {
+                    auto value = board[to];
+                    if (value) {
+                        if (!backward && COLOR(value) != color && TYPE(value) != KING)
+                            moves.push_back((TYPE(value) << 10) + (from << 15) + (to << 25));
+                        break;
+                    }
+                    moves.push_back((from << 15) + (to << 25));
+                    if (!slide)
+                        break;
+                }
+            }
+        }
+    }
+
+    /**
+     * Retrograde analysis of a bitbase, done on a scratch instance
+     * 1) every state: validity, mates, exits (captures + promotions) probed in the smaller bitbases
+     * 2) propagate the wins backwards with un-moves, until nothing changes
+     * @param bitbase
+     */
+    void buildBitbase(Bitbase &bitbase) {
+        constexpr uint8_t WIN = 1, INVALID = 2, DRAW = 4, FRESH = 8;
+        auto num_piece = bitbase.num_type + 2,
+            size = bitbase.size;
+        std::vector<uint8_t> counts(size, 0), status(size, 0);
+        std::vector<Move> moves;
+        Square movers[3], squares[4];
+        clear();
+
+        // 1) initial states
+        for (auto index = 0; index < size; index ++) {
+            auto stm = bitbaseSquares(bitbase, index, squares);
+            auto valid = (Distance(squares[0], squares[1]) > 1);
+            for (auto i = 0; i < num_piece && valid; i ++) {
+                if (board[squares[i]])
+                    valid = false;
+                board[squares[i]] = (i < 2)? COLORIZE(i, KING): bitbase.types[i - 2];
+            }
+            kings[WHITE] = squares[0];
+            kings[BLACK] = squares[1];
+            if (valid && !stm && attacked(WHITE, squares[1]))
+                valid = false;
+
+            if (!valid)
+                status[index] = INVALID;
+            else {
+                auto count = 0,
+                    num_move = 0;
+                auto win = false;
+
+                // strong side: only the promotions are exits, the other moves are found backwards
+                if (stm) {
+                    movers[0] = squares[1];
+                    bitbaseMoves(BLACK, movers, 1, false, moves);
+                }
+                else {
+                    auto num_pawn = 0;
+                    for (auto i = 2; i < num_piece; i ++)
+                        if (bitbase.types[i - 2] == PAWN)
+                            movers[num_pawn ++] = squares[i];
+                    bitbaseMoves(WHITE, movers, num_pawn, false, moves);
+                }
+
+                for (auto &move : moves) {
+                    if (!stm && !MovePromote(move))
+                        continue;
+                    auto from = MoveFrom(move),
+                        to = MoveTo(move);
+                    auto piece = board[from],
+                        target = board[to];
+                    auto promote = MovePromote(move);
+
+                    board[from] = 0;
+                    board[to] = promote? COLORIZE(stm, promote): piece;
+                    if (TYPE(piece) == KING)
+                        kings[stm] = to;
+
+                    if (!attacked(stm ^ 1, kings[stm])) {
+                        num_move ++;
+                        // exit => smaller bitbase
+                        if (target || promote) {
+                            turn = stm ^ 1;
+                            auto wdl = probeBoard(4, nullptr);
+                            if (!stm)
+                                win |= (wdl == -1);
+                            else if (wdl != 1)
+                                status[index] |= DRAW;
+                        }
+                        else
+                            count ++;
+                    }
+
+                    board[from] = piece;
+                    board[to] = target;
+                    if (TYPE(piece) == KING)
+                        kings[stm] = from;
+                }
+
+                // weak side: mated, or all the moves lose
+                if (stm) {
+                    counts[index] = count;
+                    if (!num_move)
+                        win = attacked(WHITE, squares[1]);
+                    else if (!count && !(status[index] & DRAW))
+                        win = true;
+                }
+                if (win)
+                    status[index] = WIN | FRESH;
+            }
+
+            for (auto i = 0; i < num_piece; i ++)
+                board[squares[i]] = 0;
+        }
+
+        // 2) propagate the wins
+        for (auto pass = 0; ; pass ++) {
+            uint8_t fresh = FRESH << (pass & 1),
+                next = FRESH << ((pass + 1) & 1);
+            auto changed = false;
+
+            for (auto index = 0; index < size; index ++) {
+                if (!(status[index] & fresh))
+                    continue;
+                status[index] &= ~fresh;
+
+                auto stm = bitbaseSquares(bitbase, index, squares);
+                for (auto i = 0; i < num_piece; i ++)
+                    board[squares[i]] = (i < 2)? COLORIZE(i, KING): bitbase.types[i - 2];
+
+                // un-moves of the side that just moved
+                auto mover = stm ^ 1;
+                if (mover) {
+                    movers[0] = squares[1];
+                    bitbaseMoves(BLACK, movers, 1, true, moves);
+                }
+                else {
+                    movers[0] = squares[0];
+                    for (auto i = 2; i < num_piece; i ++)
+                        movers[i - 1] = squares[i];
+                    bitbaseMoves(WHITE, movers, num_piece - 1, true, moves);
+                }
+
+                for (auto &move : moves) {
+                    Square prevs[4];
+                    auto from = MoveFrom(move);
+                    for (auto i = 0; i < num_piece; i ++)
+                        prevs[i] = (squares[i] == from)? MoveTo(move): squares[i];
+
+                    auto prev = bitbaseIndex(bitbase, prevs, mover);
+                    if (status[prev] & (WIN | INVALID))
+                        continue;
+                    // strong side: 1 winning move is enough, weak side: all moves must lose
+                    if (!mover || (!-- counts[prev] && !(status[prev] & DRAW))) {
+                        status[prev] |= WIN | next;
+                        changed = true;
+                    }
+                }
+
+                for (auto i = 0; i < num_piece; i ++)
+                    board[squares[i]] = 0;
+            }
+            if (!changed)
+                break;
+        }
+
+        // 3) pack the wins
+        bitbase.bits.assign((size + 7) >> 3, 0);
+        for (auto index = 0; index < size; index ++)
+            if (status[index] & WIN)
+                bitbase.bits[index >> 3] |= 1 << (index & 7);
+    }
+
+    /**
+     * Check if the side to move can castle now
+     * @param q 0:king side, 1:queen side
+     */
+    bool canCastle(int q) {
+        auto us = turn,
+            them = us ^ 1;
+        auto rook = castling[(us << 1) + q];
+        if (rook == EMPTY)
+            return false;
+
+        Square king = kings[us],
+            pos0 = Rank(king) << 4;
+        Square king_to = pos0 + 6 - (q << 2),
+            rook_to = king_to - 1 + (q << 1),
+            max_king = Max(king, king_to),
+            min_king = Min(king, king_to),
+            max_path = Max(max_king, Max(rook, rook_to)),
+            min_path = Min(min_king, Min(rook, rook_to));
+
+        // check that all squares are empty along the path
+        for (auto j = min_path; j <= max_path; j ++)
+            if (j != king && j != rook && board[j])
+                return false;
+
+        // check that the king is not attacked
+        for (auto j = min_king; j <= max_king; j ++)
+            if (attacked(them, j))
+                return false;
+        return true;
+    }
+
+    /**
+     * Legal moves in a canonical order, independent of the move generation: by to, promote, from
+     */
+    std::vector<Move> canonicalMoves() {
+        auto moves = legalMoves();
+        std::sort(moves.begin(), moves.end(), [](const Move a, const Move b) {return (a >> 15) < (b >> 15);});
+        return moves;
+    }
+
     /**
      * Move ordering for alpha-beta
      * - captures
@@ -683,6 +1570,22 @@ private:
         return (b & 1023) < (a & 1023);
     }
 
+    /**
+     * Compute the attack map from scratch
+     */
+    void computeAttacks() {
+        memset(attack_map, 0, sizeof(attack_map));
+        for (auto i = SQUARE_A8; i <= SQUARE_H1; i ++) {
+            if (i & 0x88) {
+                i += 7;
+                continue;
+            }
+            if (board[i])
+                attackPiece(i, 1);
+        }
+        attack_ready = true;
+    }
+
     /**
      * Uniquely identify ambiguous moves
      */
@@ -721,33 +1624,561 @@ private:
     }
 
     /**
-     * Find an entry in the transposition table
+     * Uniquely identify ambiguous moves, without the list of legal moves
+     * - only the same pieces attacking the target square are considered
      */
-    Table *findEntry(Hash hash, bool &hit) {
-        if (!hash_mode)
-            return nullptr;
+    std::string disambiguateAttackers(Move move) {
+        auto ambiguities = 0;
+        auto from = MoveFrom(move),
+            to = MoveTo(move);
+        auto same_file = 0,
+            same_rank = 0;
+        auto piece = board[from];
+        auto piece_type = TYPE(piece);
 
-        auto entry = &table[hash % TT_SIZE];
-        hit = (entry->hash == hash);
-        return entry;
+        if (piece_type == PAWN || piece_type == KING)
+            return "";
+
+        for (auto &offset : PIECE_OFFSETS[piece_type]) {
+            if (!offset)
+                break;
+            for (auto pos = to + offset; !(pos & 0x88); pos += offset) {
+                auto value = board[pos];
+                if (!value) {
+                    if (piece_type == KNIGHT)
+                        break;
+                    continue;
+                }
+
+                // a pinned piece does not count
+                if (value == piece && pos != from && safeMove(encodeMove(piece, pos, to, 0, 0, board[to]))) {
+                    ambiguities ++;
+
+                    if (Rank(from) == Rank(pos))
+                        same_rank ++;
+                    if (Filer(from) == Filer(pos))
+                        same_file ++;
+                }
+                break;
+            }
+        }
+
+        if (!ambiguities)
+            return "";
+
+        auto an = squareToAn(from, false);
+        if (same_rank > 0 && same_file > 0)
+            return an;
+        else
+            return an.substr((same_file > 0)? 1: 0, 1);
     }
 
     /**
-     * Initialise piece squares
+     * Encode a move, with the move ordering score in the low bits
      */
-    void initSquares() {
-        for (auto piece = PAWN; piece <= KING; piece ++) {
-            auto bsquares = PIECE_SQUARES[1][piece],
-                wsquares = PIECE_SQUARES[0][piece];
-            for (auto i = SQUARE_A8; i <= SQUARE_H1; i ++)
-                bsquares[((7 - Rank(i)) << 4) + Filer(i)] = wsquares[i];
-        }
+    Move encodeMove(Piece piece, Square from, Square to, uint8_t flag, Piece promote, Piece value) {
+        int capture = (flag & BITS_EN_PASSANT)? PAWN: (flag & BITS_CASTLE? NONE: TYPE(value));
+        auto score = (capture | promote)? Max(PIECE_CAPTURES[capture], PIECE_CAPTURES[promote]) - (PIECE_CAPTURES[piece] >> 3) + 50: 0;
+        auto squares = PIECE_SQUARES[COLOR(piece)][TYPE(piece)];
+
+        return 100 + squares[to] - squares[from] + (flag & BITS_CASTLE) * 30 + score
+            + (capture << 10)
+            + (flag << 13)
+            + ((from & 127) << 15)
+            + (promote << 22)
+            + ((to & 127) << 25);
     }
 
     /**
-     * Mini max tree search
+     * Evaluate a known endgame
+     * - exact material signatures first, then the generic recognizers
+     * @param scale scale factor to apply to the regular eval
+     * @return score for the side to move, SCORE_NONE if no specialized evaluator applies
      */
-    int miniMax(int depth, int max_depth, PV *pv) {
+    int evaluateEndgame(int &scale) {
+        int score = SCORE_NONE;
+        uint8_t strong = WHITE;
+        auto it = endgames.find(material_key);
+
+        // 0) bitbase: exact result, the evaluators only show the progress
+        auto wdl = probeBitbase();
+        if (wdl != SCORE_NONE) {
+            if (!wdl)
+                return 0;
+            strong = (wdl > 0)? turn: turn ^ 1;
+            score = evaluateKXK(strong);
+            if (it != endgames.end() && !it->second.scale) {
+                auto value = (this->*it->second.func)(strong);
+                if (value != SCORE_NONE)
+                    score = Max(score, value);
+            }
+            return (wdl > 0)? score: -score;
+        }
+
+        // 1) exact signature
+        if (it != endgames.end()) {
+            auto &endgame = it->second;
+            strong = endgame.strong;
+            auto value = (this->*endgame.func)(strong);
+            if (endgame.scale)
+                scale = value;
+            else
+                score = value;
+        }
+
+        // 2) generic recognizers
+        if (score == SCORE_NONE && scale == SCALE_NORMAL) {
+            int majors[2], minors[2], pawns[2];
+            for (auto color = 0; color < 2; color ++) {
+                auto base = color << 3;
+                majors[color] = MaterialCount(material_key, base + ROOK) + MaterialCount(material_key, base + QUEEN);
+                minors[color] = MaterialCount(material_key, base + KNIGHT) + MaterialCount(material_key, base + BISHOP);
+                pawns[color] = MaterialCount(material_key, base + PAWN);
+            }
+
+            // insufficient material: at most 1 minor each, or 2 knights vs bare king
+            if (!pawns[0] && !pawns[1] && !majors[0] && !majors[1]) {
+                if (minors[0] <= 1 && minors[1] <= 1)
+                    return 0;
+                for (auto color = 0; color < 2; color ++)
+                    if (!minors[color ^ 1] && minors[color] == 2 && MaterialCount(material_key, (color << 3) + KNIGHT) == 2)
+                        return 0;
+            }
+
+            // KXK: mating material vs bare king
+            for (auto color = 0; color < 2; color ++) {
+                if (majors[color ^ 1] || minors[color ^ 1] || pawns[color ^ 1])
+                    continue;
+                if (majors[color] || minors[color] >= 2) {
+                    strong = color;
+                    score = evaluateKXK(strong);
+                }
+                // KBPsK with the wrong rook pawn
+                else if (pawns[color] && minors[color] == 1 && MaterialCount(material_key, (color << 3) + BISHOP) == 1)
+                    scale = scaleKBPsK(color);
+                break;
+            }
+        }
+
+        if (score == SCORE_NONE)
+            return SCORE_NONE;
+        return (strong == turn)? score: -score;
+    }
+
+    /**
+     * Evaluate 1 position of a batch
+     * @param text FEN or packed position
+     * @param packed
+     * @param quiesce_depth 0 to skip the quiescence search
+     * @param score output: static eval, SCORE_NONE on error
+     * @param qscore output: quiescence score
+     */
+    void evaluateItem(std::string_view text, bool packed, int quiesce_depth, int &score, int &qscore) {
+        score = SCORE_NONE;
+        qscore = SCORE_NONE;
+        if (packed) {
+            if (!unpackPosition((const uint8_t *)text.data()))
+                return;
+        }
+        else if (!validFen(text) || load(std::string(text), false).empty())
+            return;
+
+        // same setup as a search => same materials as the search leaves, then evaluate + quiesce
+        prepareBitbases(Max(quiesce_depth, 0));
+        evaluatePositions();
+        createMoves(false);
+        score = evaluate();
+        if (quiesce_depth > 0)
+            qscore = quiesce(-SCORE_INFINITY, SCORE_INFINITY, quiesce_depth);
+    }
+
+    /**
+     * KBNK: drive the weak king to a corner of the bishop's color
+     * @param strong
+     * @return score for the strong side
+     */
+    int evaluateKBNK(uint8_t strong) {
+        auto bishop = findPiece(COLORIZE(strong, BISHOP));
+        auto king = kings[strong],
+            king2 = kings[strong ^ 1];
+        // a8 + h1 are light squares, like the bishop if (file + rank) is even
+        auto corner_dist = ((Filer(bishop) + Rank(bishop)) & 1)?
+            Min(Distance(king2, 7), Distance(king2, 112)):
+            Min(Distance(king2, SQUARE_A8), Distance(king2, SQUARE_H1));
+
+        return SCORE_KNOWN_WIN + materials[strong] - materials[strong ^ 1]
+            + (7 - corner_dist) * 60
+            + (7 - Distance(king, king2)) * 20;
+    }
+
+    /**
+     * KPK: rule of the square, key squares + rook pawn draws
+     * @param strong
+     * @return score for the strong side, SCORE_NONE if unclear
+     */
+    int evaluateKPK(uint8_t strong) {
+        auto pawn = findPiece(COLORIZE(strong, PAWN));
+        auto king = kings[strong],
+            king2 = kings[strong ^ 1];
+        int file = Filer(pawn),
+            forward = strong? 16: -16,
+            steps = RELATIVE_RANK(strong, pawn);
+        Square promote = file + (strong? 112: 0);
+        auto win = SCORE_KNOWN_WIN + materials[strong] - materials[strong ^ 1] + (7 - steps) * 20;
+
+        // 1) rook pawn: the weak king reached the corner
+        if ((file == 0 || file == 7) && Distance(king2, promote) <= 1)
+            return 0;
+
+        // 2) pawn is hanging => unclear
+        if (Distance(king2, pawn) == 1 && Distance(king, pawn) > 1)
+            return SCORE_NONE;
+
+        // 3) rule of the square, the strong king must not block the pawn
+        if (Filer(king) != file || (RELATIVE_RANK(strong, king) > steps)) {
+            auto race = Min(steps, 5) + ((turn == strong)? 0: 1);
+            if (Distance(king2, promote) > race)
+                return win;
+        }
+
+        // 4) key squares: 2 ranks ahead of the pawn, also 1 rank ahead if the pawn is advanced
+        int delta = Filer(king) - file;
+        if (file != 0 && file != 7 && Abs(delta) <= 1) {
+            if (king == pawn + forward * 2 + delta || (steps <= 3 && king == pawn + forward + delta))
+                return win;
+        }
+        return SCORE_NONE;
+    }
+
+    /**
+     * KXK: mop-up evaluation, push the weak king to the edge
+     * @param strong
+     * @return score for the strong side
+     */
+    int evaluateKXK(uint8_t strong) {
+        auto king = kings[strong],
+            king2 = kings[strong ^ 1];
+        return SCORE_KNOWN_WIN + materials[strong] - materials[strong ^ 1]
+            + (Abs(Filer(king2) * 2 - 7) + Abs(Rank(king2) * 2 - 7)) * 20
+            + (7 - Distance(king, king2)) * 20;
+    }
+
+    /**
+     * Evaluate the current position, see evaluate
+     * - traced: fill the trace member, compiled out otherwise
+     */
+    template <bool traced>
+    int evaluateTerms() {
+        // 1) draw
+        if (half_moves >= 100)
+            return 0;
+
+        // 2) known endgames
+        // - gated by the piece counts, without the kings: materials only include them during a search
+        int material = 0,
+            piece = 0,
+            scale = SCALE_NORMAL;
+        for (auto key = material_key; key; key >>= 4, piece ++)
+            material += (key & 15) * PIECE_SCORES[piece];
+        if ((eval_mode & 1) && material <= ENDGAME_MATERIAL) {
+            auto score = evaluateEndgame(scale);
+            if (score != SCORE_NONE) {
+                if constexpr (traced)
+                    traceSides(TRACE_ENDGAME, score * (1 - (turn << 1)));
+                return score;
+            }
+        }
+        if constexpr (traced)
+            trace[TRACE_SCALE][WHITE] = trace[TRACE_SCALE][BLACK] = scale;
+        if (!scale)
+            return 0;
+
+        int mat0 = materials[WHITE],
+            mat1 = materials[BLACK],
+            num_pawn0 = mat0 & 15,
+            num_pawn1 = mat1 & 15,
+            low0 = (!num_pawn0 && mat0 < 6000),
+            low1 = (!num_pawn1 && mat1 < 6000),
+            score = 0;
+
+        if (low0) {
+            if (low1)
+                return 0;
+            mat0 -= 300;
+            if (num_pawn1)
+                mat1 += 600;
+        }
+        else if (low1) {
+            mat1 -= 300;
+            if (num_pawn0)
+                mat0 += 600;
+        }
+
+        // 2) material
+        if (eval_mode & 1) {
+            score += mat0 - mat1;
+            // KRR vs KR => KR should not exchange the rook
+            float ratio = mat0 * 1.0f / (mat0 + mat1) - 0.5f;
+            auto bonus = int(ratio * 2048 + 0.5f);
+            score += bonus;
+
+            if constexpr (traced) {
+                trace[TRACE_MATERIAL][WHITE] = mat0;
+                trace[TRACE_MATERIAL][BLACK] = mat1;
+                traceSides(TRACE_RATIO, bonus);
+            }
+        }
+
+        // 3) mobility
+        if (eval_mode & 2) {
+            auto factor = (eval_mode & 16)? 1: 2;
+
+            // low material => king activity instead of mobility
+            for (auto color = 0; color < 2; color ++) {
+                auto base = color << 3;
+                auto is_king = ((color? mat1: mat0) <= 5000);
+                auto value = 0;
+
+                if (is_king) {
+                    auto king = kings[color],
+                        king2 = kings[color ^ 1];
+                    value -= (std::abs(Filer(king) * 2 - 7) + std::abs(Rank(king) * 2 - 7)) * 25;
+                    value += (std::abs(Filer(king) - Filer(king2)) + std::abs(Rank(king) - Rank(king2))) * 40;
+                    value += mobilities[base + KING] * 15;
+                }
+                else
+                    for (auto i = base + PAWN; i <= base + KING; i ++)
+                        value += Min(mobilities[i] * MOBILITY_SCORES[i], MOBILITY_LIMITS[i]) * factor;
+
+                score += color? -value: value;
+                if constexpr (traced)
+                    trace[is_king? TRACE_KING: TRACE_MOBILITY][color] = value;
+            }
+        }
+
+        // 4) attacks + defenses
+        if (eval_mode & 4) {
+            for (auto color = 0; color < 2; color ++) {
+                auto base = color << 3;
+                int attack = 0,
+                    defense = 0;
+                for (auto i = base + PAWN; i <= base + KING; i ++) {
+                    attack += attacks[i];
+                    defense += defenses[i];
+                }
+                score += color? -(attack + defense): attack + defense;
+                if constexpr (traced) {
+                    trace[TRACE_ATTACK][color] = attack;
+                    trace[TRACE_DEFENSE][color] = defense;
+                }
+            }
+        }
+
+        // 5) pawns
+        if (eval_mode & 8) {
+            for (auto square = SQUARE_A8; square <= SQUARE_H1; square ++) {
+                if (square & 0x88) {
+                    square += 7;
+                    continue;
+                }
+                auto piece = board[square];
+                if (piece == PAWN) {
+                    if (board[square + 1] == PAWN) {
+                        score += 15;
+                        if constexpr (traced)
+                            trace[TRACE_PAWN][WHITE] += 15;
+                    }
+                }
+                else if (piece == PAWN + 8) {
+                    if (board[square + 1] == PAWN + 8) {
+                        score -= 15;
+                        if constexpr (traced)
+                            trace[TRACE_PAWN][BLACK] += 15;
+                    }
+                }
+            }
+        }
+
+        // 6) king
+        // if (eval_mode & 16) {
+        // }
+        if (scale != SCALE_NORMAL)
+            score = score * scale / SCALE_NORMAL;
+        return score * (1 - (turn << 1));
+    }
+
+    /**
+     * Only keep the root moves that preserve the best bitbase result
+     * - nothing is filtered if a move leads to an unknown position
+     */
+    void filterBitbase() {
+        if (probeBitbase() == SCORE_NONE)
+            return;
+
+        auto best = -SCORE_INFINITY;
+        std::vector<int> results;
+        for (auto &move : first_moves) {
+            auto result = -SCORE_INFINITY;
+            if (makeMove(move)) {
+                auto wdl = probeBitbase();
+                undoMove();
+                if (wdl == SCORE_NONE)
+                    return;
+                result = -wdl;
+            }
+            results.push_back(result);
+            best = Max(best, result);
+        }
+
+        std::vector<Move> moves;
+        for (size_t i = 0; i < first_moves.size(); i ++)
+            if (results[i] == best)
+                moves.push_back(first_moves[i]);
+        first_moves = moves;
+    }
+
+    /**
+     * Find a bitbase, generate it if needed
+     * @param code KPK, KBNK: the pieces in QRBNP order
+     * @param generate generate the bitbase if it's not in the cache
+     * @return nullptr if not found
+     */
+    Bitbase *findBitbase(std::string code, bool generate) {
+        std::lock_guard<std::recursive_mutex> lock(BITBASE_MUTEX);
+        auto it = BITBASES.find(code);
+        if (it != BITBASES.end())
+            return &it->second;
+        if (!generate)
+            return nullptr;
+
+        Bitbase bitbase;
+        bitbase.num_type = code.size() - 2;
+        bitbase.pawns = false;
+        for (auto i = 0; i < bitbase.num_type; i ++) {
+            auto type = TYPE(pieceCode(code[i + 1]));
+            bitbase.types[i] = type;
+            bitbase.counts[i + 2] = (type == PAWN)? 48: 64;
+            if (type == PAWN)
+                bitbase.pawns = true;
+        }
+        bitbase.counts[0] = bitbase.pawns? 32: 16;
+        bitbase.counts[1] = 64;
+        bitbase.size = 2;
+        for (auto i = 0; i < bitbase.num_type + 2; i ++)
+            bitbase.size *= bitbase.counts[i];
+
+        auto scratch = new Chess();
+        scratch->buildBitbase(bitbase);
+        delete scratch;
+
+        auto &result = BITBASES[code];
+        result = std::move(bitbase);
+        return &result;
+    }
+
+    /**
+     * Find an entry in the transposition table
+     */
+    Table *findEntry(Hash hash, bool &hit) {
+        if (!hash_mode)
+            return nullptr;
+
+        auto entry = &table[hash % TT_SIZE];
+        hit = (entry->hash == hash);
+        return entry;
+    }
+
+    /**
+     * Find the first square of a piece
+     */
+    Square findPiece(Piece piece) {
+        for (auto i = SQUARE_A8; i <= SQUARE_H1; i ++) {
+            if (i & 0x88) {
+                i += 7;
+                continue;
+            }
+            if (board[i] == piece)
+                return i;
+        }
+        return EMPTY;
+    }
+
+    /**
+     * Build the SAN of a move
+     * @param move
+     * @param disambiguator from disambiguate or disambiguateAttackers
+     */
+    std::string formatSan(Move move, std::string disambiguator) {
+        auto move_flag = MoveFlag(move),
+            move_from = MoveFrom(move),
+            move_to = MoveTo(move);
+
+        if (move_flag & BITS_CASTLE)
+            return (move_to > move_from)? "O-O": "O-O-O";
+
+        auto move_type = TYPE(board[move_from]);
+        std::string output;
+
+        if (move_type != PAWN)
+            output += PIECE_UPPER[move_type] + disambiguator;
+
+        if (MoveCapture(move) || (move_flag & BITS_EN_PASSANT)) {
+            if (move_type == PAWN)
+                output += squareToAn(move_from, false)[0];
+            output += 'x';
+        }
+
+        output += squareToAn(move_to, false);
+
+        auto promote = MovePromote(move);
+        if (promote) {
+            output += '=';
+            output += PIECE_UPPER[promote];
+        }
+        return output;
+    }
+
+    /**
+     * Check if the side to move has at least one legal move
+     */
+    bool hasLegalMove() {
+        auto moves = createMoves(false);
+        for (auto &move : moves)
+            if (safeMove(move))
+                return true;
+        return false;
+    }
+
+    /**
+     * Initialise the specialized endgames
+     * - KXK, insufficient material + KBPsK are recognized in evaluateEndgame
+     */
+    void initEndgames() {
+        endgames.clear();
+        addEndgame("KBNK", &Chess::evaluateKBNK, false);
+        addEndgame("KPK", &Chess::evaluateKPK, false);
+    }
+
+    /**
+     * Initialise piece squares
+     * - the tables are shared by all the instances => only once
+     */
+    void initSquares() {
+        static std::once_flag once;
+        std::call_once(once, [] {
+            for (auto piece = PAWN; piece <= KING; piece ++) {
+                auto bsquares = PIECE_SQUARES[1][piece],
+                    wsquares = PIECE_SQUARES[0][piece];
+                for (auto i = SQUARE_A8; i <= SQUARE_H1; i ++)
+                    bsquares[((7 - Rank(i)) << 4) + Filer(i)] = wsquares[i];
+            }
+        });
+    }
+
+    /**
+     * Mini max tree search
+     */
+    int miniMax(int depth, int max_depth, PV *pv) {
         // transposition
         bool hit = false;
         auto entry = findEntry(board_hash, hit);
@@ -820,11 +2251,10 @@ private:
      */
     std::string moveList() {
         std::string text;
-        for (auto i = 0 ; i <= ply; i ++) {
-            auto state = ply_states[i & 127];
+        for (auto i = 0 ; i < ply; i ++) {
             if (text.size())
                 text += " ";
-            text += ucifyMove(state.move);
+            text += ucifyMove(ply_states[i].move);
         }
         return text;
     }
@@ -848,38 +2278,433 @@ private:
     }
 
     /**
-     * Quiescence search
-     * https://www.chessprogramming.org/Quiescence_Search
+     * Position key for the opening lines: board_hash without a useless en passant square
+     * - 1. d4 Nf6 2. c4 and 1. c4 Nf6 2. d4 must give the same key
+     * - board_hash must be complete, see hashBoard
+     * @returns key
      */
-    int quiesce(int alpha, int beta, int depth_left) {
-        auto delta = PIECE_SCORES[QUEEN];
-        nodes ++;
-        auto score = evaluate();
-        if (depth_left <= 0)
-            return score;
-        if (score >= beta)
-            return beta;
-        if (score + delta < alpha)
-            return alpha;
-        if (score > alpha)
-            alpha = score;
+    Hash openingKey() {
+        if (ep_square == EMPTY)
+            return board_hash;
+        for (auto delta : {15, 17}) {
+            Square square = ep_square + (turn? -delta: delta);
+            if (!(square & 0x88) && board[square] == COLORIZE(turn, PAWN))
+                return board_hash;
+        }
+        return board_hash ^ zobrist[0][ep_square];
+    }
 
-        auto best = score,
-            futility = best + PIECE_SCORES[PAWN];
+    /**
+     * Parse the eval of a mainline comment: {d=30, wv=0.35, ...}
+     * @param text comment, or part of it if it spans several lines
+     */
+    void pgnComment(std::string_view text) {
+        auto pos = text.find("wv=");
+        if (pos == std::string_view::npos || (pos && text[pos - 1] != ' ' && text[pos - 1] != ','))
+            return;
 
-        if (ply >= sel_depth)
-            sel_depth = ply + 1;
+        char buffer[24] = {0};
+        auto value = text.substr(pos + 3, sizeof(buffer) - 1);
+        memcpy(buffer, value.data(), value.size());
+        if (isdigit(buffer[0]) || ((buffer[0] == '-' || buffer[0] == '+') && isdigit(buffer[1])))
+            pgn_evals.back() = strtof(buffer, nullptr);
+        else if (buffer[0] && buffer[0] != ',')
+            pgn_evals.back() = (buffer[0] == '-')? -INFINITY: INFINITY;
+    }
 
-        auto moves = createMoves(true);
-        for (auto &move : moves) {
-            if (futility + PIECE_SCORES[MoveCapture(move)] <= alpha
-                    && (TYPE(board[MoveFrom(move)]) != PAWN || RELATIVE_RANK(turn, MoveTo(move)) <= 5))
-                continue;
+    /**
+     * Finish the current game and add it to pgn_games
+     * - PGN_SIZE values: header start, header end, first move, number of moves, result, valid
+     * - headers are "Key\tValue\n" lines in replay_text, moves are in replay_moves, see addReplay
+     * - result: 0:*, 1:1-0, 2:0-1, 3:1/2-1/2
+     * - valid: 0 if a mainline move could not be parsed, the moves stop before it
+     * @param result
+     */
+    void pgnEnd(int result) {
+        pgnStart();
+        pgn_game[4] = result;
+        pgn_games.insert(pgn_games.end(), pgn_game, pgn_game + PGN_SIZE);
+        pgn_depth = 0;
+        pgn_fen.clear();
+        pgn_state = 0;
+    }
 
-            if (!makeMove(move))
-                continue;
-            auto score = -quiesce(-beta, -alpha, depth_left - 1);
-            undoMove();
+    /**
+     * Load the start position of a game parsed by pgnFeed
+     * @param id game index
+     * @returns record in pgn_games, see pgnEnd
+     */
+    int32_t *pgnGame(int id) {
+        auto record = &pgn_games[id * PGN_SIZE];
+
+        // start position from the FEN header
+        std::string fen_ = DEFAULT_POSITION;
+        std::string_view headers = std::string_view(replay_text).substr(record[0], record[1] - record[0]);
+        auto pos = headers.find("FEN\t");
+        if (pos != std::string_view::npos && (!pos || headers[pos - 1] == '\n')) {
+            auto end = headers.find('\n', pos);
+            fen_ = headers.substr(pos + 4, end - pos - 4);
+        }
+        load(fen_, true);
+        return record;
+    }
+
+    /**
+     * Parse a header line: [Key "Value"]
+     */
+    void pgnHeader(std::string_view line) {
+        auto first = line.find('"'),
+            last = line.rfind('"'),
+            space = line.find(' ');
+        if (space == std::string_view::npos || first == std::string_view::npos || last <= first)
+            return;
+
+        if (pgn_state == 2)
+            pgnEnd(0);
+        if (!pgn_state) {
+            pgn_game[0] = replay_text.size();
+            pgn_state = 1;
+        }
+
+        auto key = line.substr(1, space - 1);
+        replay_text += key;
+        replay_text += '\t';
+        auto start = replay_text.size();
+        for (auto i = first + 1; i < last; i ++) {
+            if (line[i] == '\\' && i + 1 < last)
+                i ++;
+            replay_text += line[i];
+        }
+        if (key == "FEN")
+            pgn_fen = replay_text.substr(start);
+        replay_text += '\n';
+    }
+
+    /**
+     * Parse a complete line of PGN
+     * - comments and variations can span several lines
+     */
+    void pgnLine(std::string_view line) {
+        if (line.size() && line.back() == '\r')
+            line.remove_suffix(1);
+
+        size_t i = 0,
+            size = line.size();
+
+        // 1) escape + header
+        if (!pgn_comment) {
+            if (size && line[0] == '%')
+                return;
+            while (i < size && isspace(line[i]))
+                i ++;
+            if (i < size && line[i] == '[' && !pgn_depth) {
+                pgnHeader(line.substr(i));
+                return;
+            }
+        }
+
+        // 2) move text
+        while (i < size) {
+            if (pgn_comment) {
+                auto end = line.find('}', i);
+                if (!pgn_depth && pgn_state == 2 && pgn_game[3])
+                    pgnComment(line.substr(i, end - i));
+                if (end == std::string_view::npos)
+                    return;
+                pgn_comment = false;
+                i = end + 1;
+                continue;
+            }
+
+            auto letter = line[i];
+            if (letter == ';')
+                return;
+            if (isspace(letter))
+                i ++;
+            else if (letter == '{') {
+                pgn_comment = true;
+                i ++;
+            }
+            else if (letter == '(') {
+                pgn_depth ++;
+                i ++;
+            }
+            else if (letter == ')') {
+                if (pgn_depth)
+                    pgn_depth --;
+                i ++;
+            }
+            else if (letter == '$') {
+                for (i ++; i < size && isdigit(line[i]); i ++);
+            }
+            else {
+                auto start = i;
+                for (; i < size && !isspace(line[i]) && !strchr("{}();$", line[i]); i ++);
+                if (!pgn_depth)
+                    pgnToken(line.substr(start, i - start));
+            }
+        }
+    }
+
+    /**
+     * Start the moves of the current game: load the FEN header or the start position
+     */
+    void pgnStart() {
+        if (pgn_state == 2)
+            return;
+        if (!pgn_state)
+            pgn_game[0] = replay_text.size();
+
+        pgn_game[1] = replay_text.size();
+        pgn_game[2] = replay_moves.size() / REPLAY_SIZE;
+        pgn_game[3] = 0;
+        pgn_game[4] = 0;
+        pgn_game[5] = !load(pgn_fen.size()? pgn_fen: DEFAULT_POSITION, false).empty();
+        pgn_state = 2;
+    }
+
+    /**
+     * Split a mainline token into a SAN or a result
+     * @param token 12. 12... 12.Nf3 Nf3!? 0-0 1-0 1/2-1/2 *
+     * @param san Nf3 O-O, empty for a move number or a result
+     * @returns 0:*, 1:1-0, 2:0-1, 3:1/2-1/2, -1 if not a result
+     */
+    int pgnSan(std::string_view token, std::string &san) {
+        static const std::string_view results[] = {"*", "1-0", "0-1", "1/2-1/2"};
+        san.clear();
+        for (auto i = 0; i < 4; i ++)
+            if (token == results[i])
+                return i;
+
+        // move number
+        if (token[0] >= '1' && token[0] <= '9') {
+            size_t i = 0;
+            for (; i < token.size() && isdigit(token[i]); i ++);
+            if (i == token.size())
+                return -1;
+            if (token[i] == '.') {
+                for (; i < token.size() && token[i] == '.'; i ++);
+                token.remove_prefix(i);
+            }
+        }
+
+        // Nf3!? => Nf3, 0-0 => O-O
+        while (token.size() && (token.back() == '!' || token.back() == '?'))
+            token.remove_suffix(1);
+        san = token;
+        for (size_t i = 0; i < san.size() && (san[i] == '0' || san[i] == '-'); i ++)
+            if (san[i] == '0')
+                san[i] = 'O';
+        return -1;
+    }
+
+    /**
+     * Parse a mainline token: move number, SAN or result
+     * @param token 12. 12... 12.Nf3 Nf3 0-0 1-0 1/2-1/2 *
+     */
+    void pgnToken(std::string_view token) {
+        std::string san;
+        auto result = pgnSan(token, san);
+        if (result >= 0) {
+            pgnEnd(result);
+            return;
+        }
+        if (san.empty())
+            return;
+
+        pgnStart();
+        if (!pgn_game[5])
+            return;
+
+        auto moves = legalMoves();
+        auto obj = sanToObject(san, moves, true);
+        if (obj.from == obj.to) {
+            pgn_game[5] = 0;
+            return;
+        }
+        makeMove(packObject(obj));
+        addReplay(obj, pgn_create_fen);
+        pgn_evals.push_back(NAN);
+        pgn_game[3] ++;
+    }
+
+    /**
+     * Probe the board in the bitbases
+     * @param max_piece generate the missing bitbases up to this number of pieces, kings included
+     * @param bitbase bitbase of the material, nullptr to find it from the pieces
+     * @return 1:win, 0:draw, -1:loss for the side to move, SCORE_NONE if unknown
+     */
+    int probeBoard(int max_piece, Bitbase *bitbase) {
+        int count = 0,
+            strong = -1;
+        Square squares[4];
+        Piece types[2];
+
+        for (auto i = SQUARE_A8; i <= SQUARE_H1; i ++) {
+            if (i & 0x88) {
+                i += 7;
+                continue;
+            }
+            auto piece = board[i];
+            if (!piece || TYPE(piece) == KING)
+                continue;
+            // the weak side must have a bare king
+            if (count >= 2 || (strong >= 0 && COLOR(piece) != strong))
+                return SCORE_NONE;
+            strong = COLOR(piece);
+            types[count] = TYPE(piece);
+            squares[count + 2] = i;
+            count ++;
+        }
+        if (!count)
+            return 0;
+
+        // QRBNP order
+        if (count == 2 && types[1] > types[0]) {
+            std::swap(types[0], types[1]);
+            std::swap(squares[2], squares[3]);
+        }
+        if (!bitbase) {
+            std::string code = "K";
+            for (auto i = 0; i < count; i ++)
+                code += PIECE_UPPER[types[i]];
+            code += 'K';
+
+            bitbase = findBitbase(code, count + 2 <= max_piece);
+            if (!bitbase)
+                return SCORE_NONE;
+        }
+
+        // the strong side becomes white
+        int flip = strong? 0x70: 0,
+            stm = (turn == strong)? 0: 1;
+        squares[0] = kings[strong] ^ flip;
+        squares[1] = kings[strong ^ 1] ^ flip;
+        for (auto i = 0; i < count; i ++)
+            squares[i + 2] ^= flip;
+
+        auto index = bitbaseIndex(*bitbase, squares, stm);
+        if (!((bitbase->bits[index >> 3] >> (index & 7)) & 1))
+            return 0;
+        return stm? -1: 1;
+    }
+
+    /**
+     * Validate a single move without generating the move list
+     * - castle is in FRC format: the king takes its own rook
+     * @param from
+     * @param to
+     * @param promote ignored if not a promotion
+     * @returns the encoded move if pseudo-legal, else 0
+     */
+    Move pseudoMove(Square from, Square to, Piece promote) {
+        if ((from & 0x88) || (to & 0x88) || from == to)
+            return 0;
+
+        auto us = turn;
+        auto piece = board[from];
+        if (!piece || COLOR(piece) != us)
+            return 0;
+
+        uint8_t flag = 0;
+        auto piece_type = TYPE(piece);
+        auto value = board[to];
+
+        // castle
+        if (piece_type == KING && value == COLORIZE(us, ROOK)) {
+            for (auto q = 0; q < 2; q ++)
+                if (castling[(us << 1) + q] == to && canCastle(q))
+                    return encodeMove(piece, from, to, BITS_CASTLE, 0, 0);
+            return 0;
+        }
+        if (value && COLOR(value) == us)
+            return 0;
+
+        if (piece_type == PAWN) {
+            auto offsets = PAWN_OFFSETS[us];
+            if (to == from + offsets[1]) {
+                if (value)
+                    return 0;
+            }
+            else if (to == from + offsets[1] * 2) {
+                if (value || board[from + offsets[1]] || Rank(from) != 6 - us * 5)
+                    return 0;
+            }
+            else if (to == from + offsets[0] || to == from + offsets[2]) {
+                if (!value) {
+                    if (to != ep_square)
+                        return 0;
+                    flag = BITS_EN_PASSANT;
+                }
+            }
+            else
+                return 0;
+
+            auto rank = Rank(to);
+            if (rank == 0 || rank == 7) {
+                if (promote < KNIGHT || promote > QUEEN)
+                    return 0;
+            }
+            else
+                promote = 0;
+        }
+        else {
+            auto found = false;
+            for (auto &offset : PIECE_OFFSETS[piece_type]) {
+                if (!offset)
+                    break;
+                for (auto pos = from + offset; !(pos & 0x88); pos += offset) {
+                    if (pos == to) {
+                        found = true;
+                        break;
+                    }
+                    if (board[pos] || piece_type == KING || piece_type == KNIGHT)
+                        break;
+                }
+                if (found)
+                    break;
+            }
+            if (!found)
+                return 0;
+            promote = 0;
+        }
+
+        return encodeMove(piece, from, to, flag, promote, value);
+    }
+
+    /**
+     * Quiescence search
+     * https://www.chessprogramming.org/Quiescence_Search
+     */
+    int quiesce(int alpha, int beta, int depth_left) {
+        auto delta = PIECE_SCORES[QUEEN];
+        nodes ++;
+        auto score = evaluate();
+        if (depth_left <= 0)
+            return score;
+        if (score >= beta)
+            return beta;
+        if (score + delta < alpha)
+            return alpha;
+        if (score > alpha)
+            alpha = score;
+
+        auto best = score,
+            futility = best + PIECE_SCORES[PAWN];
+
+        if (ply >= sel_depth)
+            sel_depth = ply + 1;
+
+        auto moves = createMoves(true);
+        for (auto &move : moves) {
+            if (futility + PIECE_SCORES[MoveCapture(move)] <= alpha
+                    && (TYPE(board[MoveFrom(move)]) != PAWN || RELATIVE_RANK(turn, MoveTo(move)) <= 5))
+                continue;
+
+            if (!makeMove(move))
+                continue;
+            auto score = -quiesce(-beta, -alpha, depth_left - 1);
+            undoMove();
 
             if (score > best) {
                 best = score;
@@ -894,6 +2719,173 @@ private:
         return best;
     }
 
+    /**
+     * Play a move from the replay buffers
+     * @param id move index in replay_moves
+     */
+    void replayMove(int id) {
+        auto data = &replay_moves[id * REPLAY_SIZE];
+        MoveText obj((Piece)data[3], (uint8_t)data[2], (Square)data[0], (Piece)data[4], 0, (Square)data[1]);
+        makeMove(packObject(obj));
+    }
+
+    /**
+     * Go back to the root after a PV
+     */
+    void rewindRoot() {
+        while (ply > 0)
+            undoMove();
+    }
+
+    /**
+     * Check that a pseudo-legal move does not leave the king in check
+     * - castle was fully verified by canCastle
+     */
+    bool safeMove(Move move) {
+        if (MoveFlag(move) & BITS_CASTLE)
+            return true;
+
+        auto us = turn;
+        auto move_from = MoveFrom(move),
+            move_to = MoveTo(move);
+        uint8_t passant = (MoveFlag(move) & BITS_EN_PASSANT)? move_to + 16 - (us << 5): EMPTY;
+        auto piece_from = board[move_from],
+            piece_to = board[move_to];
+        auto is_king = (TYPE(piece_from) == KING);
+
+        if (is_king)
+            kings[us] = move_to;
+        board[move_from] = 0;
+        board[move_to] = piece_from;
+        if (passant != EMPTY)
+            board[passant] = 0;
+
+        auto safe = !kingAttacked(us);
+
+        if (is_king)
+            kings[us] = move_from;
+        board[move_from] = piece_from;
+        board[move_to] = piece_to;
+        if (passant != EMPTY)
+            board[passant] = COLORIZE(us ^ 1, PAWN);
+        return safe;
+    }
+
+    /**
+     * KBPsK: all pawns on a rook file + the bishop does not control the promotion square
+     * @param strong
+     * @return scale factor
+     */
+    int scaleKBPsK(uint8_t strong) {
+        auto file = EMPTY;
+        auto pawn = COLORIZE(strong, PAWN);
+        for (auto i = SQUARE_A8; i <= SQUARE_H1; i ++) {
+            if (i & 0x88) {
+                i += 7;
+                continue;
+            }
+            if (board[i] != pawn)
+                continue;
+            if (file == EMPTY)
+                file = Filer(i);
+            if (Filer(i) != file || (file != 0 && file != 7))
+                return SCALE_NORMAL;
+        }
+
+        Square promote = file + (strong? 112: 0);
+        auto bishop = findPiece(COLORIZE(strong, BISHOP));
+        if (((Filer(bishop) + Rank(bishop)) & 1) != ((Filer(promote) + Rank(promote)) & 1)
+                && Distance(kings[strong ^ 1], promote) <= 1)
+            return 0;
+        return SCALE_NORMAL;
+    }
+
+    /**
+     * Trace a term that favors one side
+     * @param term
+     * @param score > 0 for white, < 0 for black
+     */
+    void traceSides(int term, int score) {
+        trace[term][WHITE] = Max(score, 0);
+        trace[term][BLACK] = Max(-score, 0);
+    }
+
+    /**
+     * Load a packed position, see packPosition
+     * @param data PACKED_SIZE bytes
+     * @return false if the position is invalid
+     */
+    bool unpackPosition(const uint8_t *data) {
+        clear();
+        for (auto i = 0; i < 64; i ++) {
+            Piece piece = (data[i >> 1] >> ((i & 1) << 2)) & 15;
+            if (!piece)
+                continue;
+            if (TYPE(piece) == 0 || TYPE(piece) == 7)
+                return false;
+            Square square = ((i >> 3) << 4) + (i & 7);
+            if (TYPE(piece) == KING && kings[COLOR(piece)] != EMPTY)
+                return false;
+            put(piece, square);
+        }
+        if (kings[WHITE] == EMPTY || kings[BLACK] == EMPTY)
+            return false;
+
+        auto flags = data[32];
+        turn = flags & 1;
+        ep_square = (flags >> 4)? ((turn? 0x50: 0x20) + (flags >> 4) - 1): EMPTY;
+        half_moves = data[33];
+        fen_ply = turn;
+
+        // castling: a rook of the color on its first rank
+        for (auto id = 0; id < 4; id ++) {
+            Square square = data[34 + id];
+            if (square == EMPTY)
+                continue;
+            auto color = id >> 1;
+            if ((square & 0x88) || Rank(square) != (color? 0: 7) || board[square] != COLORIZE(color, ROOK))
+                return false;
+            castling[id] = square;
+        }
+        return true;
+    }
+
+    /**
+     * Update the attack map after some squares changed on the board
+     * @param squares changed squares, can contain duplicates
+     * @param befores pieces on those squares before the change
+     * @param count
+     */
+    void updateAttacks(Square *squares, Piece *befores, int count) {
+        Piece afters[4];
+        auto num_square = 0;
+
+        // 1) restore the old pieces on the unique squares
+        for (auto i = 0; i < count; i ++) {
+            auto square = squares[i];
+            auto found = false;
+            for (auto j = 0; j < num_square; j ++)
+                if (squares[j] == square) {
+                    found = true;
+                    break;
+                }
+            if (found)
+                continue;
+            afters[num_square] = board[square];
+            befores[num_square] = befores[i];
+            squares[num_square ++] = square;
+            board[square] = befores[i];
+        }
+
+        // 2) remove the old pieces, then put the new ones
+        for (auto i = 0; i < num_square; i ++)
+            if (befores[i])
+                attackRemove(squares[i]);
+        for (auto i = 0; i < num_square; i ++)
+            if (afters[i])
+                attackPut(squares[i], afters[i]);
+    }
+
     /**
      * Update an entry
      */
@@ -911,17 +2903,160 @@ private:
         tt_adds ++;
     }
 
+    /**
+     * Check the board of a FEN before loading it: 8 ranks of 8 squares + 1 king per side
+     * @param fen
+     * @return true if the board is valid
+     */
+    static bool validFen(std::string_view fen) {
+        int kings[2] = {0, 0},
+            rank = 0,
+            square = 0;
+
+        for (auto letter : fen) {
+            if (letter == ' ')
+                break;
+            if (letter == '/') {
+                if (square != 8)
+                    return false;
+                rank ++;
+                square = 0;
+            }
+            else if (letter >= '1' && letter <= '8')
+                square += letter - '0';
+            else if (!strchr("PNBRQKpnbrqk", letter) || !letter)
+                return false;
+            else {
+                if (letter == 'K' || letter == 'k')
+                    kings[letter == 'k'] ++;
+                square ++;
+            }
+            if (square > 8)
+                return false;
+        }
+        return rank == 7 && square == 8 && kings[0] == 1 && kings[1] == 1;
+    }
+
 public:
     // PUBLIC
     /////////
 
     Chess() {
         configure(false, "", 4);
+        attack_track = false;
         clear();
         load(DEFAULT_POSITION, false);
+        agreeReset(0, false);
+        pgnReset(false);
+        track_prefix = 0;
+        initEndgames();
         initSquares();
     }
     ~Chess() {
+        for (auto worker : batch_workers)
+            delete worker;
+    }
+
+    /**
+     * Store the PV of a side at a ply, see agreeLengths
+     * @param side 0, 1
+     * @param ply_ ply of the first PV move
+     * @param fen_ position before the first PV move
+     * @param multi UCI moves: c2c4 a7a8a ...
+     * @returns number of legal moves stored
+     */
+    int agreeAdd(int side, int ply_, std::string fen_, std::string multi) {
+        if (ply_ < 0 || side < 0 || side > 1)
+            return 0;
+
+        // 1) move or position keys
+        std::vector<Hash> keys;
+        load(fen_, agree_hash);
+        int prev = 0,
+            size = multi.size();
+        for (int i = 0; i <= size; i ++) {
+            if (i < size && multi[i] != ' ')
+                continue;
+
+            if (multi[prev] >= 'A') {
+                auto obj = moveUci(multi.substr(prev, i - prev), true);
+                if (obj.from == obj.to || !obj.m.size())
+                    break;
+                keys.push_back(agree_hash? openingKey(): (obj.from + (obj.to << 8) + (obj.promote << 16)));
+            }
+            prev = i + 1;
+        }
+
+        auto &pvs = agree_keys[side];
+        if ((int)pvs.size() <= ply_)
+            pvs.resize(ply_ + 1);
+        pvs[ply_] = keys;
+
+        // 2) plies to recompute: players mode => side 0 is compared with itself
+        int last = agree_keys[0].size();
+        if ((int)agree_cache.size() < last)
+            agree_cache.resize(last, -2);
+        if (side == 0)
+            agree_cache[ply_] = -2;
+        if (side == 1 || agree_offset < 0) {
+            auto ply2 = ply_ - agree_offset;
+            if (ply2 >= 0 && ply2 < last)
+                agree_cache[ply2] = -2;
+        }
+        return keys.size();
+    }
+
+    /**
+     * Agree length of every ply: number of PV moves both sides agree on
+     * - the PV of side 0 at ply is compared with the PV of side 1 at ply + offset
+     * - hash mode: last position reached by both PVs at the same ply, so transpositions count
+     * - only the plies with a new PV are recomputed
+     * @returns -1 if a PV is missing or empty
+     */
+    const std::vector<int> &agreeLengths() {
+        int num_ply = agree_cache.size(),
+            side2 = (agree_offset < 0)? 0: 1;
+        auto &pvs0 = agree_keys[0],
+            &pvs1 = agree_keys[side2];
+
+        for (auto ply_ = 0; ply_ < num_ply; ply_ ++) {
+            if (agree_cache[ply_] != -2)
+                continue;
+
+            auto ply2 = ply_ + agree_offset;
+            if (ply_ >= (int)pvs0.size() || ply2 < 0 || ply2 >= (int)pvs1.size() || pvs0[ply_].empty() || pvs1[ply2].empty()) {
+                agree_cache[ply_] = -1;
+                continue;
+            }
+
+            // compare the moves played at the same ply
+            auto &keys0 = pvs0[ply_],
+                &keys1 = pvs1[ply2];
+            int agree = 0,
+                i = Max(0, agree_offset),
+                j = Max(0, -agree_offset);
+            for (int k = 0; i + k < (int)keys0.size() && j + k < (int)keys1.size(); k ++) {
+                if (keys0[i + k] == keys1[j + k])
+                    agree = k + 1;
+                else if (!agree_hash)
+                    break;
+            }
+            agree_cache[ply_] = agree;
+        }
+        return agree_cache;
+    }
+
+    /**
+     * Clear the PVs, see agreeLengths
+     * @param offset compare the PV of side 0 at ply with side 1 at ply + offset, < 0 to compare side 0 with itself (players)
+     * @param by_hash compare the positions instead of the moves
+     */
+    void agreeReset(int offset, bool by_hash) {
+        agree_cache.clear();
+        agree_hash = by_hash;
+        agree_keys[0].clear();
+        agree_keys[1].clear();
+        agree_offset = offset;
     }
 
     /**
@@ -1014,6 +3149,8 @@ public:
      * Clear the board
      */
     void clear() {
+        memset(attack_map, 0, sizeof(attack_map));
+        attack_ready = false;
         memset(attacks, 0, sizeof(attacks));
         avg_depth = 0;
         memset(board, 0, sizeof(board));
@@ -1022,10 +3159,12 @@ public:
         memset(defenses, 0, sizeof(defenses));
         ep_square = EMPTY;
         fen = "";
+        fen_dirty = 255;
         fen_ply = -1;
         half_moves = 0;
         is_search = false;
         memset(kings, EMPTY, sizeof(kings));
+        material_key = 0;
         memset(materials, 0, sizeof(materials));
         memset(mobilities, 0, sizeof(mobilities));
         move_id = 0;
@@ -1035,8 +3174,8 @@ public:
         memset(pieces, 0, sizeof(pieces));
         memset(positions, 0, sizeof(positions));
         ply = 0;
-        memset(ply_states, 0, sizeof(ply_states));
         sel_depth = 0;
+        memset(trace, 0, sizeof(trace));
         turn = WHITE;
     }
 
@@ -1047,6 +3186,7 @@ public:
      * @param depth this overrides max_depth if > 0
      */
     void configure(bool frc_, std::string options, int depth) {
+        bitbase_mode = 1;
         debug = 0;
         eval_mode = 1;
         frc = frc_;
@@ -1072,6 +3212,9 @@ public:
             auto right = option.substr(2);
             auto value = std::atoi(right.c_str());
             switch (left) {
+            case 'b':
+                bitbase_mode = value;
+                break;
             case 'd':
                 max_depth = value;
                 break;
@@ -1121,61 +3264,82 @@ public:
 
     /**
      * Create the FEN
+     * - only the ranks changed since the last call are rebuilt, see fen_dirty
+     * - the result is assembled in the fen buffer
      * @return fen
      */
     std::string createFen() {
-        auto empty = 0;
-        fen = "";
+        // 1) placement of the dirty ranks
+        for (auto rank = 0; rank < 8; rank ++) {
+            if (!(fen_dirty & (1 << rank)))
+                continue;
 
-        for (auto i = SQUARE_A8; i <= SQUARE_H1; i ++) {
-            auto piece = board[i];
-            if (!piece)
-                empty ++;
-            else {
-                if (empty > 0) {
-                    fen += ('0' + empty);
-                    empty = 0;
+            auto empty = 0;
+            auto &text = fen_ranks[rank];
+            text.clear();
+            for (auto i = rank << 4; i < (rank << 4) + 8; i ++) {
+                auto piece = board[i];
+                if (!piece)
+                    empty ++;
+                else {
+                    if (empty > 0) {
+                        text += ('0' + empty);
+                        empty = 0;
+                    }
+                    text += PIECE_NAMES[piece];
                 }
-                fen += PIECE_NAMES[piece];
             }
+            if (empty > 0)
+                text += ('0' + empty);
+        }
+        fen_dirty = 0;
 
-            // off board
-            if ((i + 1) & 0x88) {
-                if (empty > 0)
-                    fen += ('0' + empty);
-                if (i != SQUARE_H1)
-                    fen += '/';
-
-                empty = 0;
-                i += 8;
-            }
+        fen.clear();
+        for (auto rank = 0; rank < 8; rank ++) {
+            if (rank)
+                fen += '/';
+            fen += fen_ranks[rank];
         }
+        fen += ' ';
+        fen += COLOR_TEXT(turn);
+        fen += ' ';
 
-        std::string castle;
+        // 2) castle
+        auto size = fen.size();
         if (frc) {
             for (auto &square : castling)
                 if (square != EMPTY) {
                     auto file = Filer(square),
                         rank = Rank(square);
                     if (rank > 0)
-                        castle += (file + 'A');
+                        fen += (file + 'A');
                     else
-                        castle += (file + 'a');
+                        fen += (file + 'a');
                 }
         }
         else {
-            if (castling[0] != EMPTY) castle += 'K';
-            if (castling[1] != EMPTY) castle += 'Q';
-            if (castling[2] != EMPTY) castle += 'k';
-            if (castling[3] != EMPTY) castle += 'q';
+            if (castling[0] != EMPTY) fen += 'K';
+            if (castling[1] != EMPTY) fen += 'Q';
+            if (castling[2] != EMPTY) fen += 'k';
+            if (castling[3] != EMPTY) fen += 'q';
         }
 
         // empty castling flag?
-        if (castle.empty())
-            castle = "-";
-        std::string epflags = (ep_square == EMPTY)? "-": squareToAn(ep_square, false);
+        if (fen.size() == size)
+            fen += '-';
 
-        fen = fen + " " + COLOR_TEXT(turn) + " " + castle + " " + epflags + " " + std::to_string(half_moves) + " " + std::to_string(move_number);
+        // 3) en passant + clocks
+        fen += ' ';
+        if (ep_square == EMPTY)
+            fen += '-';
+        else {
+            fen += ('a' + Filer(ep_square));
+            fen += ('8' - Rank(ep_square));
+        }
+        fen += ' ';
+        fen += std::to_string(half_moves);
+        fen += ' ';
+        fen += std::to_string(move_number);
         return fen;
     }
 
@@ -1356,45 +3520,12 @@ public:
             }
         }
 
-        // 2) castling
+        // 2) castling, always in FRC format
+        // q=0: king side, q=1: queen side
         if (!only_capture) {
-            Square king = kings[us],
-                pos0 = Rank(king) << 4;
-
-            // q=0: king side, q=1: queen side
-            for (auto q = 0; q < 2; q ++) {
-                auto rook = castling[(us << 1) + q];
-                if (rook == EMPTY)
-                    continue;
-
-                auto error = false;
-                Square king_to = pos0 + 6 - (q << 2),
-                    rook_to = king_to - 1 + (q << 1),
-                    max_king = Max(king, king_to),
-                    min_king = Min(king, king_to),
-                    max_path = Max(max_king, Max(rook, rook_to)),
-                    min_path = Min(min_king, Min(rook, rook_to));
-
-                // check that all squares are empty along the path
-                for (auto j = min_path; j <= max_path; j ++)
-                    if (j != king && j != rook && board[j]) {
-                        error = true;
-                        break;
-                    }
-                if (error)
-                    continue;
-
-                // check that the king is not attacked
-                for (auto j = min_king; j <= max_king; j ++)
-                    if (attacked(them, j)) {
-                        error = true;
-                        break;
-                    }
-
-                // add castle, always in FRC format
-                if (!error)
-                    addMove(moves, COLORIZE(us, KING), king, rook, BITS_CASTLE, 0, 0);
-            }
+            for (auto q = 0; q < 2; q ++)
+                if (canCastle(q))
+                    addMove(moves, COLORIZE(us, KING), kings[us], castling[(us << 1) + q], BITS_CASTLE, 0, 0);
         }
 
         // move ordering for alpha-beta
@@ -1403,116 +3534,324 @@ public:
         return moves;
     }
 
+    /**
+     * Decode a game from the binary format, see encodeGame
+     * - resets the PGN parser: the headers + moves go to the replay buffers, with 1 record in pgn_games, see pgnEnd
+     * - game_columns: eval in centipawns or SCORE_NONE, depth or -1, time or -1, 3 values per move
+     * @param data
+     * @param create_fen add the FEN of each move
+     * @returns number of moves, -1 if the data is truncated
+     */
+    int decodeGame(std::string data, bool create_fen) {
+        pgnReset(create_fen);
+        game_columns.clear();
+
+        auto bytes = (const uint8_t *)data.data();
+        size_t pos = 3,
+            size = data.size();
+        if (size < 3)
+            return -1;
+        int columns = bytes[0],
+            num_header = bytes[2];
+
+        // 1) headers
+        for (auto i = 0; i < num_header; i ++) {
+            if (pos + 1 > size || pos + 1 + bytes[pos] + 2 > size)
+                return -1;
+            auto key = data.substr(pos + 1, bytes[pos]);
+            pos += 1 + key.size();
+            size_t length = bytes[pos] + (bytes[pos + 1] << 8);
+            if (pos + 2 + length > size)
+                return -1;
+            auto value = data.substr(pos + 2, length);
+            pos += 2 + length;
+
+            replay_text += key + '\t' + value + '\n';
+            if (key == "FEN")
+                pgn_fen = value;
+        }
+
+        // 2) moves
+        if (pos + 2 > size)
+            return -1;
+        int num_move = bytes[pos] + (bytes[pos + 1] << 8);
+        pos += 2;
+        if (pos + num_move > size)
+            return -1;
+
+        pgn_state = 1;
+        pgnStart();
+        for (auto i = 0; i < num_move && pgn_game[5]; i ++) {
+            auto moves = canonicalMoves();
+            auto index = bytes[pos + i];
+            if (index >= moves.size()) {
+                pgn_game[5] = 0;
+                break;
+            }
+            auto move = moves[index];
+            auto obj = unpackMove(move);
+            obj.m = moveToSan(move, moves);
+            makeMove(move);
+            obj.m = decorateSan(obj.m);
+            addReplay(obj, create_fen);
+            pgn_game[3] ++;
+        }
+        pos += num_move;
+        pgnEnd(bytes[1]);
+
+        // 3) columns
+        game_columns.resize(num_move * 3, -1);
+        for (auto i = 0; i < num_move; i ++)
+            game_columns[i * 3] = SCORE_NONE;
+        if (columns & 1) {
+            for (auto i = 0; i < num_move && pos + 2 <= size; i ++, pos += 2) {
+                auto eval = (int16_t)(bytes[pos] + (bytes[pos + 1] << 8));
+                game_columns[i * 3] = (eval == -32768)? SCORE_NONE: eval;
+            }
+        }
+        if (columns & 2) {
+            for (auto i = 0; i < num_move && pos + 1 <= size; i ++, pos ++)
+                game_columns[i * 3 + 1] = (bytes[pos] == 255)? -1: bytes[pos];
+        }
+        if (columns & 4) {
+            for (auto i = 0; i < num_move && pos + 4 <= size; i ++, pos += 4) {
+                uint32_t time_ = bytes[pos] + (bytes[pos + 1] << 8) + (bytes[pos + 2] << 16) + ((uint32_t)bytes[pos + 3] << 24);
+                game_columns[i * 3 + 2] = (time_ == 0xffffffff)? -1: (int32_t)time_;
+            }
+        }
+        return pgn_game[3];
+    }
+
     /**
      * Decorate the SAN with + or #
      */
     std::string decorateSan(std::string san) {
         char last = san[san.size() - 1];
-        if (last != '+' && last != '#' && kingAttacked(turn)) {
-            auto moves = legalMoves();
-            san += moves.size()? '+': '#';
-        }
+        if (last != '+' && last != '#' && kingAttacked(turn))
+            san += hasLegalMove()? '+': '#';
         return san;
     }
 
+    /**
+     * Encode a game in a compact binary format, 1 byte per move, see decodeGame
+     * - u8 columns: &1:evals, &2:depths, &4:times
+     * - u8 result: 0:*, 1:1-0, 2:0-1, 3:1/2-1/2
+     * - u8 number of headers, then for each header: u8 key size, key, u16 value size, value
+     * - u16 number of moves, then for each move: u8 index in canonicalMoves
+     * - columns, 1 value per move: i16 eval in centipawns, u8 depth, u32 time in ms
+     * - little endian, missing values: -32768, 255, 0xffffffff
+     * @param headers "Key\tValue\n" lines, the FEN header is the start position
+     * @param multi SAN moves, move numbers + annotations are skipped: 1. e4 e5 2. Nf3!?
+     * @param result
+     * @param evals evals in pawns separated by spaces, - if missing, empty to skip the column
+     * @param depths same format
+     * @param times same format, in ms
+     * @returns binary game, empty if a move is invalid
+     */
+    std::string encodeGame(std::string headers, std::string multi, int result, std::string evals, std::string depths, std::string times) {
+        std::string data(3, 0);
+        data[1] = result;
+
+        // 1) headers
+        std::string_view view(headers);
+        std::string fen_ = DEFAULT_POSITION;
+        int num_header = 0;
+        size_t start = 0;
+        while (start < view.size() && num_header < 255) {
+            auto end = view.find('\n', start);
+            if (end == std::string_view::npos)
+                end = view.size();
+            auto line = view.substr(start, end - start);
+            start = end + 1;
+
+            auto tab = line.find('\t');
+            if (tab == std::string_view::npos || !tab || tab > 255 || line.size() - tab - 1 > 65535)
+                continue;
+            auto key = line.substr(0, tab),
+                value = line.substr(tab + 1);
+            data += (char)key.size();
+            data += key;
+            data += (char)(value.size() & 255);
+            data += (char)(value.size() >> 8);
+            data += value;
+            if (key == "FEN")
+                fen_ = std::string(value);
+            num_header ++;
+        }
+        data[2] = num_header;
+
+        // 2) moves
+        load(fen_, false);
+        std::string indices,
+            san;
+        int prev = 0,
+            size = multi.size();
+        for (int i = 0; i <= size && indices.size() < 65535; i ++) {
+            if (i < size && multi[i] != ' ')
+                continue;
+            auto token = std::string_view(multi).substr(prev, i - prev);
+            prev = i + 1;
+            if (token.empty() || pgnSan(token, san) >= 0 || san.empty())
+                continue;
+
+            auto moves = canonicalMoves();
+            auto obj = sanToObject(san, moves, true);
+            if (obj.from == obj.to)
+                return "";
+            int index = 0;
+            for (auto &move : moves) {
+                if (MoveFrom(move) == obj.from && MoveTo(move) == obj.to && MovePromote(move) == obj.promote)
+                    break;
+                index ++;
+            }
+            indices += (char)index;
+            makeMove(moves[index]);
+        }
+        int num_move = indices.size();
+        data += (char)(num_move & 255);
+        data += (char)(num_move >> 8);
+        data += indices;
+
+        // 3) columns
+        std::string *texts[3] = {&evals, &depths, &times};
+        for (auto id = 0; id < 3; id ++) {
+            auto &text = *texts[id];
+            if (text.empty())
+                continue;
+            data[0] |= 1 << id;
+
+            auto ptr = text.c_str();
+            for (auto i = 0; i < num_move; i ++) {
+                for (; *ptr == ' '; ptr ++);
+                char *end;
+                auto number = strtod(ptr, &end);
+                auto missing = (end == ptr);
+                for (ptr = end; *ptr && *ptr != ' '; ptr ++);
+
+                if (id == 0) {
+                    int value = missing? -32768: Max(-32767, Min(32767, (int)std::round(number * 100)));
+                    data += (char)(value & 255);
+                    data += (char)((value >> 8) & 255);
+                }
+                else if (id == 1)
+                    data += (char)(missing? 255: Max(0, Min(254, (int)number)));
+                else {
+                    uint32_t value = (missing || number < 0)? 0xffffffff: (uint32_t)std::min(number, 4294967294.0);
+                    for (auto j = 0; j < 4; j ++)
+                        data += (char)((value >> (j << 3)) & 255);
+                }
+            }
+        }
+        return data;
+    }
+
     /**
      * Evaluate the current position
      * - eval_mode: 0:nul, 1:mat, 2:hc2, 4:att, 8:paw, 16:kin, 32:nn
      * - 8/5q2/8/3K4/8/8/8/7k w - - 0 1 KQ vs K
      * - 8/5r2/8/3K4/8/8/8/7k w - - 0 1 KR vs K
      * - 8/5n2/8/3K4/8/8/b7/7k w - - 0 1  KNB vs K
+     * - low material goes through the bitbases + endgames table first, see evaluateEndgame
      */
     int evaluate() {
-        // 1) draw
-        if (half_moves >= 100)
-            return 0;
-        int mat0 = materials[WHITE],
-            mat1 = materials[BLACK],
-            num_pawn0 = mat0 & 15,
-            num_pawn1 = mat1 & 15,
-            low0 = (!num_pawn0 && mat0 < 6000),
-            low1 = (!num_pawn1 && mat1 < 6000),
-            score = 0;
+        return evaluateTerms<false>();
+    }
 
-        if (low0) {
-            if (low1)
-                return 0;
-            mat0 -= 300;
-            if (num_pawn1)
-                mat1 += 600;
-        }
-        else if (low1) {
-            mat1 -= 300;
-            if (num_pawn0)
-                mat0 += 600;
-        }
+    /**
+     * Evaluate the current position and fill the trace
+     * - trace[term][color]: points of each side for the term, the score is their difference (scaled)
+     * - TRACE_ENDGAME: a known endgame short-circuited the other terms
+     * - TRACE_SCALE: scale factor for both sides, SCALE_NORMAL = 64
+     * - not used by the search => the bitbases of the position can be generated
+     * @return same as evaluate
+     */
+    int evaluateTrace() {
+        prepareBitbases(0);
+        memset(trace, 0, sizeof(trace));
+        return evaluateTerms<true>();
+    }
 
-        // 2) material
-        if (eval_mode & 1) {
-            score += mat0 - mat1;
-            // KRR vs KR => KR should not exchange the rook
-            float ratio = mat0 * 1.0f / (mat0 + mat1) - 0.5f;
-            score += int(ratio * 2048 + 0.5f);
+    /**
+     * Evaluate a batch of positions, with 1 Chess instance per thread
+     * - the instances are created on the first call, then reused
+     * - the settings are copied from this instance, its position is not modified
+     * @param data FEN lines, or packed positions of PACKED_SIZE bytes
+     * @param packed
+     * @param quiesce_depth > 0 to add the quiescence scores
+     * @param num_thread 0 to use all the cores, always 1 in wasm
+     * @return static evals, followed by the quiescence scores, SCORE_NONE for invalid positions
+     */
+    std::vector<int> evaluateBatch(std::string data, bool packed, int quiesce_depth, int num_thread) {
+        // 1) split the positions, empty lines are skipped
+        std::vector<std::string_view> items;
+        std::string_view view(data);
+        if (packed) {
+            for (size_t i = 0; i + PACKED_SIZE <= view.size(); i += PACKED_SIZE)
+                items.push_back(view.substr(i, PACKED_SIZE));
         }
-
-        // 3) mobility
-        if (eval_mode & 2) {
-            auto factor = (eval_mode & 16)? 1: 2;
-
-            if (mat0 <= 5000) {
-                auto king = kings[WHITE],
-                    king2 = kings[BLACK];
-                score -= (std::abs(Filer(king) * 2 - 7) + std::abs(Rank(king) * 2 - 7)) * 25;
-                score += (std::abs(Filer(king) - Filer(king2)) + std::abs(Rank(king) - Rank(king2))) * 40;
-                score += mobilities[6] * 15;
-            }
-            else
-                for (auto i = 1; i < 7; i ++)
-                    score += Min(mobilities[i] * MOBILITY_SCORES[i], MOBILITY_LIMITS[i]) * factor;
-
-            if (mat1 <= 5000) {
-                auto king = kings[BLACK],
-                    king2 = kings[WHITE];
-                score += (std::abs(Filer(king) * 2 - 7) + std::abs(Rank(king) * 2 - 7)) * 25;
-                score -= (std::abs(Filer(king) - Filer(king2)) + std::abs(Rank(king) - Rank(king2))) * 40;
-                score -= mobilities[14] * 15;
+        else {
+            size_t start = 0;
+            while (start < view.size()) {
+                auto end = view.find('\n', start);
+                if (end == std::string_view::npos)
+                    end = view.size();
+                auto line = view.substr(start, end - start);
+                while (line.size() && isspace(line.back()))
+                    line.remove_suffix(1);
+                if (line.size())
+                    items.push_back(line);
+                start = end + 1;
             }
-            else
-                for (auto i = 9; i < 15; i ++)
-                    score -= Min(mobilities[i] * MOBILITY_SCORES[i], MOBILITY_LIMITS[i]) * factor;
         }
 
-        // 4) attacks + defenses
-        if (eval_mode & 4) {
-            for (auto i = 1; i < 7; i ++)
-                score += attacks[i] + defenses[i];
-            for (auto i = 9; i < 15; i ++)
-                score -= attacks[i] + defenses[i];
+        int num_item = items.size();
+        std::vector<int> scores(num_item * ((quiesce_depth > 0)? 2: 1), SCORE_NONE);
+
+        // 2) workers
+#ifdef __EMSCRIPTEN__
+        num_thread = 1;
+#else
+        if (num_thread <= 0)
+            num_thread = std::thread::hardware_concurrency();
+#endif
+        num_thread = Max(1, Min(num_thread, (num_item + 63) / 64));
+
+        while ((int)batch_workers.size() < num_thread)
+            batch_workers.push_back(new Chess());
+        for (auto i = 0; i < num_thread; i ++) {
+            auto worker = batch_workers[i];
+            worker->bitbase_mode = bitbase_mode;
+            worker->eval_mode = eval_mode;
+            worker->frc = frc;
         }
 
-        // 5) pawns
-        if (eval_mode & 8) {
-            for (auto square = SQUARE_A8; square <= SQUARE_H1; square ++) {
-                if (square & 0x88) {
-                    square += 7;
-                    continue;
-                }
-                auto piece = board[square];
-                if (piece == PAWN) {
-                    if (board[square + 1] == PAWN)
-                        score += 15;
-                }
-                else if (piece == PAWN + 8) {
-                    if (board[square + 1] == PAWN + 8)
-                        score -= 15;
+        // 3) evaluate, blocks of 64 positions
+        std::atomic<int> next(0);
+        auto run = [&](Chess *worker) {
+            while (true) {
+                int start = next.fetch_add(64);
+                if (start >= num_item)
+                    break;
+                for (auto i = start; i < Min(start + 64, num_item); i ++) {
+                    int qscore;
+                    worker->evaluateItem(items[i], packed, quiesce_depth, scores[i], qscore);
+                    if (quiesce_depth > 0)
+                        scores[num_item + i] = qscore;
                 }
             }
-        }
+        };
 
-        // 6) king
-        // if (eval_mode & 16) {
-        // }
-        return score * (1 - (turn << 1));
+#ifdef __EMSCRIPTEN__
+        run(batch_workers[0]);
+#else
+        std::vector<std::thread> threads;
+        for (auto i = 1; i < num_thread; i ++)
+            threads.emplace_back(run, batch_workers[i]);
+        run(batch_workers[0]);
+        for (auto &thread : threads)
+            thread.join();
+#endif
+        return scores;
     }
 
     /**
@@ -1521,6 +3860,7 @@ public:
     void evaluatePositions() {
         memset(attacks, 0, sizeof(attacks));
         memset(defenses, 0, sizeof(defenses));
+        material_key = 0;
         memset(materials, 0, sizeof(materials));
         memset(mobilities, 0, sizeof(mobilities));
         memset(positions, 0, sizeof(positions));
@@ -1534,11 +3874,33 @@ public:
             if (!piece)
                 continue;
             auto color = COLOR(piece);
+            if (TYPE(piece) != KING)
+                material_key += MaterialUnit(piece);
             materials[color] += PIECE_SCORES[piece];
             positions[color] += PIECE_SQUARES[color][TYPE(piece)][i];
         }
     }
 
+    /**
+     * Generate a bitbase, or get it from the cache
+     * - the strong side is white, the weak side has a bare king
+     * @param code KPK, KQK, KRK, KBNK, ...
+     * @return size in bytes, 0 if the code is not supported
+     */
+    int generateBitbase(std::string code) {
+        if (code.size() < 3 || code.size() > 4 || code.front() != 'K' || code.back() != 'K')
+            return 0;
+
+        auto middle = code.substr(1, code.size() - 2);
+        for (auto &letter : middle)
+            if (!strchr("QRBNP", letter) || !letter)
+                return 0;
+        std::sort(middle.begin(), middle.end(), [](char a, char b) {return pieceCode(a) > pieceCode(b);});
+
+        auto bitbase = findBitbase("K" + middle + "K", true);
+        return bitbase? bitbase->bits.size(): 0;
+    }
+
     /**
      * Hash the current board
      */
@@ -1603,12 +3965,14 @@ public:
     /**
      * Initialise the zobrist table
      * - 0 is used for en passant + castling
+     * - same seed for every instance => the hashes can be compared between instances and threads
      */
     void initZobrist() {
         auto collision = 0;
+        Hash seed = 1070372ull;
 
-        xorshift64();
-        zobrist_side = xorshift64();
+        xorshift64(seed);
+        zobrist_side = xorshift64(seed);
         std::set<Hash> seens;
 
         for (auto i = SQUARE_A8; i <= SQUARE_H1; i ++) {
@@ -1619,7 +3983,7 @@ public:
             for (auto j = 0; j <= 14; j ++) {
                 if (j && !PIECE_ORDERS[j])
                     continue;
-                auto x = xorshift64();
+                auto x = xorshift64(seed);
                 if (seens.find(x) != seens.end()) {
                     collision ++;
                     break;
@@ -1634,6 +3998,15 @@ public:
         zobrist_ready = true;
     }
 
+    /**
+     * Check if a move is legal, without generating the move list
+     * - the move ordering bits are ignored
+     */
+    bool isLegal(Move move) {
+        auto legal = pseudoMove(MoveFrom(move), MoveTo(move), MovePromote(move));
+        return legal && (legal >> 10) == (move >> 10) && safeMove(legal);
+    }
+
     /**
      * Check if the king is attacked
      * @param color 0, 1 + special cases: 2, 3
@@ -1645,6 +4018,64 @@ public:
         return attacked(color ^ 1, kings[color]);
     }
 
+    /**
+     * Find the least valuable piece of a color attacking a square
+     * - uses the attack map: rebuilt from scratch on the first query after a move, unless trackAttacks(true) was called
+     * @param color attacking color
+     * @param square .
+     * @returns square of the attacker, or EMPTY
+     */
+    Square leastAttacker(int color, Square square) {
+        if (!attack_ready)
+            computeAttacks();
+        if (!attack_map[color][Square64(square)])
+            return EMPTY;
+
+        // pawn
+        auto target = COLORIZE(color, PAWN);
+        for (auto k = 0; k < 3; k += 2) {
+            auto pos = square - PAWN_OFFSETS[color][k];
+            if (!(pos & 0x88) && board[pos] == target)
+                return pos;
+        }
+
+        // knight
+        target = COLORIZE(color, KNIGHT);
+        for (auto &offset : PIECE_OFFSETS[KNIGHT]) {
+            auto pos = square + offset;
+            if (!(pos & 0x88) && board[pos] == target)
+                return pos;
+        }
+
+        // bishop + rook + queen
+        auto best = EMPTY;
+        auto best_type = KING;
+        auto offsets = PIECE_OFFSETS[QUEEN];
+        for (auto j = 0; j < 8; j ++) {
+            auto offset = offsets[j];
+            auto pos = square + offset;
+            while (!(pos & 0x88) && !board[pos])
+                pos += offset;
+            if (pos & 0x88)
+                continue;
+
+            auto value = board[pos];
+            auto piece_type = TYPE(value);
+            if (COLOR(value) == color && piece_type < best_type && (piece_type == QUEEN || piece_type == BISHOP + (j & 1))) {
+                best = pos;
+                best_type = piece_type;
+            }
+        }
+        if (best != EMPTY)
+            return best;
+
+        // king
+        auto king = kings[color];
+        if (king != EMPTY && Distance(king, square) == 1)
+            return king;
+        return EMPTY;
+    }
+
     /**
      * Get a list of all legal moves
      */
@@ -1681,7 +4112,7 @@ public:
             square = 0;
         std::string castle, ep;
 
-        for (auto i = 0; i < fen.size(); i ++) {
+        for (size_t i = 0; i < fen.size(); i ++) {
             auto value = fen[i];
             if (value == ' ') {
                 step ++;
@@ -1700,7 +4131,7 @@ public:
                 else if (value >= '1' && value <= '9')
                     square += value - '0';
                 else {
-                    put(PIECES[value], square);
+                    put(pieceCode(value), square);
                     square ++;
                 }
                 break;
@@ -1828,7 +4259,7 @@ public:
                 kings[us] = move_to;
             board[move_from] = 0;
             board[move_to] = promote? promote: piece_from;
-            if (passant)
+            if (passant != EMPTY)
                 board[passant] = 0;
 
             if (kingAttacked(us)) {
@@ -1837,14 +4268,16 @@ public:
                     kings[us] = move_from;
                 board[move_from] = piece_from;
                 board[move_to] = piece_to;
-                if (passant)
+                if (passant != EMPTY)
                     board[passant] = COLORIZE(them, PAWN);
                 return false;
             }
         }
 
         // 2) move is legal => do all other stuff
+        // en passant + castle only change the ranks of from and to
         addState(move);
+        fen_dirty |= (1 << Rank(move_from)) | (1 << Rank(move_to));
 
         half_moves ++;
         hashEnPassant();
@@ -1869,6 +4302,14 @@ public:
             board[king_to] = king_piece;
             board[rook_to] = rook_piece;
 
+            if (!attack_track)
+                attack_ready = false;
+            else if (attack_ready) {
+                Square changes[4] = {king, rook, (Square)king_to, (Square)rook_to};
+                Piece befores[4] = {king_piece, rook_piece, 0, 0};
+                updateAttacks(changes, befores, 4);
+            }
+
             kings[us] = king_to;
             hashCastle(us << 1);
             hashCastle((us << 1) + 1);
@@ -1881,11 +4322,21 @@ public:
         }
         else {
             hashSquare(move_from, piece_from);
-            hashSquare(move_to, piece_to);
+            if (piece_to)
+                hashSquare(move_to, piece_to);
             hashSquare(move_to, promote? promote: piece_from);
 
+            if (!attack_track)
+                attack_ready = false;
+            else if (attack_ready) {
+                Square changes[3] = {move_from, move_to, passant};
+                Piece befores[3] = {piece_from, piece_to, (Piece)COLORIZE(them, PAWN)};
+                updateAttacks(changes, befores, (passant != EMPTY)? 3: 2);
+            }
+
             // remove castling if we capture a rook
             if (capture) {
+                material_key -= MaterialUnit(COLORIZE(them, capture));
                 materials[them] -= PIECE_SCORES[capture];
                 if (capture == ROOK) {
                     if (move_to == castling[them << 1])
@@ -1910,12 +4361,16 @@ public:
             // pawn + update 50MR
             else if (piece_type == PAWN) {
                 if (passant != EMPTY)
-                    hashEnPassant();
-                else if (promote)
+                    hashSquare(passant, COLORIZE(them, PAWN));
+                else if (promote) {
+                    material_key += MaterialUnit(promote) - MaterialUnit(piece_from);
                     materials[us] += PROMOTE_SCORES[promote];
+                }
                 // pawn moves 2 squares
-                else if (std::abs(Rank(move_to) - Rank(move_from)) == 2)
+                else if (std::abs(Rank(move_to) - Rank(move_from)) == 2) {
                     ep_square = move_to + 16 - (turn << 5);
+                    hashEnPassant();
+                }
                 half_moves = 0;
             }
 
@@ -1932,61 +4387,39 @@ public:
         return true;
     }
 
+    /**
+     * Try a SAN or UCI move
+     * @param text Nf3, e2e4, a7a8q
+     * @param decorate add + # decorators
+     */
+    MoveText moveAuto(std::string text, bool decorate) {
+        auto is_uci = (text.size() >= 4 && text[0] >= 'a' && text[0] <= 'h' && isdigit(text[1])
+            && text[2] >= 'a' && text[2] <= 'h' && isdigit(text[3]));
+        return is_uci? moveUci(text, decorate): moveSan(text, decorate, true);
+    }
+
     /**
      * Try an object move
      * @param move {from: 23, to: 7, promote: 5}
      * @param decorate add + # decorators
      */
     MoveText moveObject(MoveText &obj, bool decorate) {
-        auto flag = 0;
-        Move move = 0;
         auto move_from = obj.from,
             move_to = obj.to;
-        auto moves = legalMoves();
-        std::string san;
-
-        // castle
-        if (move_from == kings[turn]) {
-            auto piece = board[move_to];
-
-            // regular notation => change .to to rook position
-            if (!piece) {
-                if (std::abs(Filer(move_from) - Filer(move_to)) == 2) {
-                    if (move_to > move_from)
-                        move_to ++;
-                    else
-                        move_to -= 2;
-                }
-            }
-            // frc notation
-            else if (piece == COLORIZE(turn, ROOK))
-                flag = BITS_CASTLE;
-        }
 
-        // find an existing match + add the SAN
-        if (flag) {
-            for (auto &move2 : moves)
-                if ((MoveFlag(move2) & flag) && move_to == MoveTo(move2)) {
-                    move = move2;
-                    san = moveToSan(move, moves);
-                    break;
-                }
+        // castle: regular notation => change .to to rook position
+        if (move_from == kings[turn] && !board[move_to] && std::abs(Filer(move_from) - Filer(move_to)) == 2) {
+            if (move_to > move_from)
+                move_to ++;
+            else
+                move_to -= 2;
         }
-        else
-            for (auto &move2 : moves) {
-                if (move_from != MoveFrom(move2) || move_to != MoveTo(move2))
-                    continue;
-                auto promote = MovePromote(move2);
-                if (promote && obj.promote != promote)
-                    continue;
-
-                move = move2;
-                san = moveToSan(move, moves);
-                break;
-            }
 
-        // no suitable move?
-        if (move && makeMove(move)) {
+        // validate the single move + add the SAN
+        auto move = pseudoMove(move_from, move_to, obj.promote);
+        if (move && safeMove(move)) {
+            auto san = formatSan(move, disambiguateAttackers(move));
+            makeMove(move);
             obj = unpackMove(move);
             obj.m = decorate? decorateSan(san): san;
             obj.ply = fen_ply + ply;
@@ -2020,34 +4453,9 @@ public:
      * @param moves
      */
     std::string moveToSan(Move move, std::vector<Move> &moves) {
-        auto move_flag = MoveFlag(move),
-            move_from = MoveFrom(move),
-            move_to = MoveTo(move);
-
-        if (move_flag & BITS_CASTLE)
-            return (move_to > move_from)? "O-O": "O-O-O";
-
-        std::string disambiguator = disambiguate(move, moves);
-        auto move_type = TYPE(board[move_from]);
-        std::string output;
-
-        if (move_type != PAWN)
-            output += PIECE_UPPER[move_type] + disambiguator;
-
-        if (MoveCapture(move) || (move_flag & BITS_EN_PASSANT)) {
-            if (move_type == PAWN)
-                output += squareToAn(move_from, false)[0];
-            output += 'x';
-        }
-
-        output += squareToAn(move_to, false);
-
-        auto promote = MovePromote(move);
-        if (promote) {
-            output += '=';
-            output += PIECE_UPPER[promote];
-        }
-        return output;
+        if (MoveFlag(move) & BITS_CASTLE)
+            return formatSan(move, "");
+        return formatSan(move, disambiguate(move, moves));
     }
 
     /**
@@ -2058,7 +4466,7 @@ public:
     MoveText moveUci(std::string text, bool decorate) {
         MoveText obj;
         obj.from = anToSquare(text.substr(0, 2));
-        obj.promote = text[4]? TYPE(PIECES[text[4]]): 0;
+        obj.promote = text[4]? TYPE(pieceCode(text[4])): 0;
         obj.to = anToSquare(text.substr(2, 2));
         return moveObject(obj, decorate);
     }
@@ -2093,6 +4501,37 @@ public:
         return result;
     }
 
+    /**
+     * Parse a list of SAN moves into the replay buffers, see addReplay
+     * - same as multiSan, without a JS object per move
+     * @param text c2c4 a7a8a ...
+     * @param sloppy allow sloppy parser
+     * @returns number of moves
+     */
+    int multiSanPacked(std::string multi, bool sloppy, bool create_fen) {
+        int prev = 0,
+            size = multi.size();
+        replay_moves.clear();
+        replay_text.clear();
+
+        for (int i = 0; i <= size; i ++) {
+            if (i < size && multi[i] != ' ')
+                continue;
+
+            if (multi[prev] >= 'A') {
+                auto text = multi.substr(prev, i - prev);
+                auto moves = legalMoves();
+                auto obj = sanToObject(text, moves, sloppy);
+                if (obj.from == obj.to)
+                    break;
+                makeMove(packObject(obj));
+                addReplay(obj, create_fen);
+            }
+            prev = i + 1;
+        }
+        return replay_moves.size() / REPLAY_SIZE;
+    }
+
     /**
      * Parse a list of UCI moves + create SAN + FEN for each move
      * @param text c2c4 a7a8a ...
@@ -2122,18 +4561,91 @@ public:
     }
 
     /**
-     * Move ordering for alpha-beta
-     * - captures
-     * - castle
-     * - nb/r/q/r/p
+     * Parse several lists of UCI moves from the same root into the replay buffers, see addReplay
+     * - the root is loaded once, each PV is undone before the next one
+     * - the moves of all PVs follow each other in the buffers
+     * @param fen_ root position
+     * @param multis PVs separated by '\n': c2c4 a7a8a ...\nd2d4 ...
+     * @returns number of valid moves of each PV, parsing stops at the first invalid move
+     */
+    std::vector<int> multiUciBatch(std::string fen_, std::string multis) {
+        std::vector<int> counts;
+        int count = 0,
+            prev = 0,
+            size = multis.size();
+        bool valid = true;
+        replay_moves.clear();
+        replay_text.clear();
+        load(fen_, false);
+
+        for (int i = 0; i <= size; i ++) {
+            if (i < size && multis[i] != ' ' && multis[i] != '\n')
+                continue;
+
+            if (valid && multis[prev] >= 'A') {
+                auto text = multis.substr(prev, i - prev);
+                auto obj = moveUci(text, true);
+                if (obj.from == obj.to || !obj.m.size())
+                    valid = false;
+                else {
+                    addReplay(obj, true);
+                    count ++;
+                }
+            }
+            prev = i + 1;
+
+            // end of a PV => back to the root
+            if (i == size || multis[i] == '\n') {
+                counts.push_back(count);
+                rewindRoot();
+                count = 0;
+                valid = true;
+            }
+        }
+        return counts;
+    }
+
+    /**
+     * Parse a list of UCI moves into the replay buffers, see addReplay
+     * - same as multiUci, without a JS object per move
+     * @param text c2c4 a7a8a ...
+     * @returns number of moves
+     */
+    int multiUciPacked(std::string multi) {
+        int prev = 0,
+            size = multi.size();
+        replay_moves.clear();
+        replay_text.clear();
+
+        for (int i = 0; i <= size; i ++) {
+            if (i < size && multi[i] != ' ')
+                continue;
+
+            if (multi[prev] >= 'A') {
+                auto text = multi.substr(prev, i - prev);
+                auto obj = moveUci(text, true);
+                if (obj.from == obj.to || !obj.m.size())
+                    break;
+                addReplay(obj, true);
+            }
+            prev = i + 1;
+        }
+        return replay_moves.size() / REPLAY_SIZE;
+    }
+
+    /**
+     * Move ordering for alpha-beta
+     * - captures
+     * - castle
+     * - nb/r/q/r/p
      */
     void orderMoves(std::vector<Move> &moves) {
         // use previous PV to reorder the first move
-        if (!move_id && (order_mode & 2) && prev_pv.size() > ply) {
+        if (!move_id && (order_mode & 2) && (int)prev_pv.size() > ply) {
             auto first = prev_pv[ply];
             auto from = anToSquare(first.substr(0, 2)),
                 to = anToSquare(first.substr(2, 2));
-            auto promote = first[4]? TYPE(PIECES[first[4]]): 0;
+            auto promote = first[4]? TYPE(pieceCode(first[4])): 0;
 
             auto id = 0;
             for (auto &move : moves) {
@@ -2164,6 +4676,26 @@ public:
             + ((obj.to & 127) << 25);
     }
 
+    /**
+     * Pack the position in PACKED_SIZE bytes, for evaluateBatch
+     * - 0-31 : 64 squares from a8 to h1, 4 bits per piece, low nibble first
+     * - 32 : bit 0 = turn, bits 4-7 = en passant file + 1
+     * - 33 : half moves
+     * - 34-37 : castling rook squares KQkq, EMPTY if the right is lost
+     */
+    std::string packPosition() {
+        std::string data(PACKED_SIZE, 0);
+        for (auto i = 0; i < 64; i ++) {
+            auto piece = board[((i >> 3) << 4) + (i & 7)];
+            data[i >> 1] |= piece << ((i & 1) << 2);
+        }
+        data[32] = turn | ((ep_square != EMPTY)? (Filer(ep_square) + 1) << 4: 0);
+        data[33] = half_moves;
+        for (auto id = 0; id < 4; id ++)
+            data[34 + id] = castling[id];
+        return data;
+    }
+
     /**
      * Get params
      */
@@ -2179,6 +4711,262 @@ public:
         return result;
     }
 
+    /**
+     * Parse the engine comments of a game into columns, 1 row per mainline comment
+     * - {d=21, sd=57, mt=192630, tl=5217370, s=19738, n=3801954, pv=e4 b6 Bg5, tb=0, wv=0.72, ...}
+     * - missing values are -1, or NaN for the eval, a mate (wv=M12 or -M12) is +-infinity
+     * - the 64 bit counters are doubles, exact up to 2^53, to be viewed as typed arrays
+     * @param fen_ start position, empty for the default position
+     * @param text move text, headers and variations are skipped
+     * @param check_pv replay the game to count the legal moves of each PV, else -1
+     * @returns number of rows, see em_comments
+     */
+    int parseComments(std::string fen_, std::string text, bool check_pv) {
+        comment_depths.clear();
+        comment_evals.clear();
+        comment_nodes.clear();
+        comment_plies.clear();
+        comment_pvs.clear();
+        comment_sel_depths.clear();
+        comment_speeds.clear();
+        comment_tbhits.clear();
+        comment_text = text;
+        comment_time_lefts.clear();
+        comment_times.clear();
+
+        load(fen_.size()? fen_: DEFAULT_POSITION, false);
+        auto data = comment_text.c_str();
+        int depth = 0,
+            num_move = 0,
+            size = comment_text.size();
+        Move last = 0;
+        std::string san;
+        auto valid = check_pv;
+
+        for (int i = 0; i < size; ) {
+            auto letter = data[i];
+            if (isspace(letter))
+                i ++;
+            else if (letter == '[' && !depth) {
+                for (; i < size && data[i] != ']'; i ++);
+                i ++;
+            }
+            else if (letter == ';') {
+                for (; i < size && data[i] != '\n'; i ++);
+            }
+            else if (letter == '(') {
+                depth ++;
+                i ++;
+            }
+            else if (letter == ')') {
+                if (depth)
+                    depth --;
+                i ++;
+            }
+            else if (letter == '$') {
+                for (i ++; i < size && isdigit(data[i]); i ++);
+            }
+            else if (letter == '{') {
+                auto start = ++ i;
+                for (; i < size && data[i] != '}'; i ++);
+                auto end = i ++;
+                if (depth || !num_move)
+                    continue;
+
+                // 1) key=value, ...
+                int32_t depth_ = -1, pv_end = -1, pv_start = -1, sel_depth = -1, time_left = -1, time_ = -1;
+                double nodes_ = -1, speed = -1, tbhits = -1;
+                float eval = NAN;
+                for (auto j = start; j < end; ) {
+                    for (; j < end && (data[j] == ' ' || data[j] == ','); j ++);
+                    auto key = j;
+                    for (; j < end && data[j] != '=' && data[j] != ','; j ++);
+                    if (j >= end || data[j] != '=')
+                        continue;
+                    auto key_size = j - key,
+                        value = ++ j;
+                    for (; j < end && data[j] != ','; j ++);
+
+                    auto code = key_size | (data[key] << 8) | ((key_size > 1)? (data[key + 1] << 16): 0);
+                    switch (code) {
+                    case 1 | ('d' << 8): depth_ = atoi(data + value); break;
+                    case 1 | ('n' << 8): nodes_ = strtod(data + value, nullptr); break;
+                    case 1 | ('s' << 8): speed = strtod(data + value, nullptr); break;
+                    case 2 | ('m' << 8) | ('t' << 16): time_ = atoi(data + value); break;
+                    case 2 | ('p' << 8) | ('v' << 16): pv_start = value; pv_end = j; break;
+                    case 2 | ('s' << 8) | ('d' << 16): sel_depth = atoi(data + value); break;
+                    case 2 | ('t' << 8) | ('b' << 16): tbhits = strtod(data + value, nullptr); break;
+                    case 2 | ('t' << 8) | ('l' << 16): time_left = atoi(data + value); break;
+                    case 2 | ('w' << 8) | ('v' << 16):
+                        if (isdigit(data[value]) || ((data[value] == '-' || data[value] == '+') && isdigit(data[value + 1])))
+                            eval = strtof(data + value, nullptr);
+                        else if (value < j)
+                            eval = (data[value] == '-')? -INFINITY: INFINITY;
+                        break;
+                    }
+                }
+
+                // 2) legal moves of the PV, from the position before the move
+                int legal = -1;
+                if (valid && pv_start >= 0) {
+                    legal = 0;
+                    undoMove();
+                    for (auto j = pv_start; j < pv_end && legal < 100; ) {
+                        for (; j < pv_end && data[j] == ' '; j ++);
+                        auto word = j;
+                        for (; j < pv_end && data[j] != ' '; j ++);
+                        if (pgnSan(std::string_view(data + word, j - word), san) >= 0 || san.empty())
+                            continue;
+                        auto moves = legalMoves();
+                        auto obj = sanToObject(san, moves, true);
+                        if (obj.from == obj.to)
+                            break;
+                        makeMove(packObject(obj));
+                        legal ++;
+                    }
+                    for (auto j = 0; j < legal; j ++)
+                        undoMove();
+                    makeMove(last);
+                }
+
+                comment_depths.push_back(depth_);
+                comment_evals.push_back(eval);
+                comment_nodes.push_back(nodes_);
+                comment_plies.push_back(fen_ply + num_move);
+                comment_pvs.insert(comment_pvs.end(), {pv_start, pv_end, legal});
+                comment_sel_depths.push_back(sel_depth);
+                comment_speeds.push_back(speed);
+                comment_tbhits.push_back(tbhits);
+                comment_time_lefts.push_back(time_left);
+                comment_times.push_back(time_);
+            }
+            else {
+                auto start = i;
+                for (; i < size && !isspace(data[i]) && !strchr("{}();$", data[i]); i ++);
+                if (depth || pgnSan(std::string_view(data + start, i - start), san) >= 0 || san.empty())
+                    continue;
+
+                num_move ++;
+                if (valid) {
+                    auto moves = legalMoves();
+                    auto obj = sanToObject(san, moves, true);
+                    if (obj.from == obj.to)
+                        valid = false;
+                    else {
+                        last = packObject(obj);
+                        makeMove(last);
+                    }
+                }
+            }
+        }
+        return comment_plies.size();
+    }
+
+    /**
+     * Parse UCI info lines, and convert their PV from the root position
+     * - the lines can have a prefix: 1612345678.123 Stockfish(1): info depth 20 ...
+     * - lines without info, or info string, are skipped
+     * - INFO_SIZE values per record, -1 if missing:
+     *   line, depth, seldepth, multipv, score, score type (0:none, 1:cp, 2:mate), bound (0:exact, 1:lower, 2:upper),
+     *   nodes, nps, hashfull, tbhits, time, legal PV moves, first PV move in the replay buffers
+     * @param fen_ root position
+     * @param text engine log
+     * @param create_fen add the FEN of each PV move, see addReplay
+     * @returns number of records, see em_infos
+     */
+    int parseInfos(std::string fen_, std::string text, bool create_fen) {
+        static const std::map<std::string_view, int> keys = {
+            {"cpuload", -1}, {"currline", -1}, {"currmove", -1}, {"currmovenumber", -1},
+            {"depth", 1}, {"hashfull", 9}, {"multipv", 3}, {"nodes", 7}, {"nps", 8}, {"pv", 12},
+            {"refutation", -1}, {"sbhits", -1}, {"score", 4}, {"seldepth", 2}, {"string", -1},
+            {"tbhits", 10}, {"time", 11}, {"wdl", -1},
+        };
+
+        info_records.clear();
+        replay_moves.clear();
+        replay_text.clear();
+        load(fen_, false);
+
+        std::string_view view(text);
+        size_t start = 0;
+        for (int line_id = 0; start < view.size(); line_id ++) {
+            auto end = view.find('\n', start);
+            if (end == std::string_view::npos)
+                end = view.size();
+            auto line = view.substr(start, end - start);
+            start = end + 1;
+
+            // 1) split the words after info
+            auto pos = line.find("info ");
+            if (pos == std::string_view::npos || (pos && line[pos - 1] != ' '))
+                continue;
+            std::vector<std::string_view> words;
+            for (auto i = pos + 5; i < line.size(); ) {
+                for (; i < line.size() && isspace(line[i]); i ++);
+                auto word = i;
+                for (; i < line.size() && !isspace(line[i]); i ++);
+                if (i > word)
+                    words.push_back(line.substr(word, i - word));
+            }
+            if (words.empty() || words[0] == "string")
+                continue;
+
+            // 2) key value pairs
+            double record[INFO_SIZE];
+            std::fill(record, record + INFO_SIZE, -1.0);
+            record[0] = line_id;
+            record[5] = 0;
+
+            int num_word = words.size();
+            for (auto i = 0; i < num_word; i ++) {
+                auto it = keys.find(words[i]);
+                if (it == keys.end() || it->second < 0)
+                    continue;
+
+                auto index = it->second;
+                if (index == 4) {
+                    // score cp 35 lowerbound
+                    if (i + 2 >= num_word)
+                        break;
+                    record[4] = atof(std::string(words[i + 2]).c_str());
+                    record[5] = (words[i + 1] == "mate")? 2: 1;
+                    record[6] = 0;
+                    i += 2;
+                    if (i + 1 < num_word && (words[i + 1] == "lowerbound" || words[i + 1] == "upperbound")) {
+                        record[6] = (words[i + 1] == "lowerbound")? 1: 2;
+                        i ++;
+                    }
+                }
+                else if (index == 12) {
+                    // pv e2e4 e7e5 ... until the next key
+                    int count = 0;
+                    auto valid = true;
+                    record[13] = replay_moves.size() / REPLAY_SIZE;
+                    for (i ++; i < num_word && keys.find(words[i]) == keys.end(); i ++) {
+                        if (!valid)
+                            continue;
+                        auto obj = moveUci(std::string(words[i]), true);
+                        if (obj.from == obj.to || !obj.m.size())
+                            valid = false;
+                        else {
+                            addReplay(obj, create_fen);
+                            count ++;
+                        }
+                    }
+                    i --;
+                    record[12] = count;
+                    rewindRoot();
+                }
+                else if (i + 1 < num_word) {
+                    record[index] = atof(std::string(words[i + 1]).c_str());
+                    i ++;
+                }
+            }
+            info_records.insert(info_records.end(), record, record + INFO_SIZE);
+        }
+        return info_records.size() / INFO_SIZE;
+    }
+
     /**
      * Perform perft and divide
      * @param {string} fen
@@ -2215,6 +5003,159 @@ public:
         return result;
     }
 
+    /**
+     * Parse a chunk of PGN, the chunks can be cut anywhere
+     * - only the incomplete last line is kept, the moves are replayed on the board while parsing
+     * - the games finished by the previous call are removed from the buffers first
+     * - mainline only: comments, NAGs and variations are skipped
+     * @param chunk
+     * @param last end of the input => finish the current game
+     * @returns number of games finished by this call, see em_pgnGames + pgnEnd
+     */
+    int pgnFeed(std::string chunk, bool last) {
+        // 1) remove the previous games, but not the current one
+        int move_shift = (pgn_state == 2)? pgn_game[2]: replay_moves.size() / REPLAY_SIZE,
+            text_shift = pgn_state? pgn_game[0]: replay_text.size();
+        pgn_evals.erase(pgn_evals.begin(), pgn_evals.begin() + move_shift);
+        replay_moves.erase(replay_moves.begin(), replay_moves.begin() + move_shift * REPLAY_SIZE);
+        replay_text.erase(0, text_shift);
+        for (size_t i = 0; i < replay_moves.size(); i += REPLAY_SIZE) {
+            replay_moves[i + 6] -= text_shift;
+            replay_moves[i + 7] -= text_shift;
+        }
+        pgn_game[0] -= text_shift;
+        pgn_game[1] -= text_shift;
+        pgn_game[2] -= move_shift;
+        pgn_games.clear();
+
+        // 2) complete the line of the previous chunk
+        std::string_view view(chunk);
+        size_t start = 0;
+        if (pgn_buffer.size()) {
+            auto end = view.find('\n');
+            if (end == std::string_view::npos) {
+                pgn_buffer += view;
+                start = view.size();
+            }
+            else {
+                pgn_buffer += view.substr(0, end);
+                pgnLine(pgn_buffer);
+                pgn_buffer.clear();
+                start = end + 1;
+            }
+        }
+
+        // 3) lines
+        while (start < view.size()) {
+            auto end = view.find('\n', start);
+            if (end == std::string_view::npos)
+                break;
+            pgnLine(view.substr(start, end - start));
+            start = end + 1;
+        }
+        if (start < view.size())
+            pgn_buffer += view.substr(start);
+
+        if (last) {
+            if (pgn_buffer.size())
+                pgnLine(pgn_buffer);
+            pgn_buffer.clear();
+            if (pgn_state)
+                pgnEnd(0);
+            pgn_comment = false;
+        }
+        return pgn_games.size() / PGN_SIZE;
+    }
+
+    /**
+     * List the current position, for the archive tools
+     * - 1 line: hash, FEN, ply, game id, result
+     * @param lines output
+     * @param game_id
+     * @param result 0:*, 1:1-0, 2:0-1, 3:1/2-1/2
+     */
+    void pgnPosition(std::string &lines, int game_id, int result) {
+        static const char *results[] = {"*", "1-0", "0-1", "1/2-1/2"};
+        char hex[20];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)board_hash);
+        lines += hex;
+        lines += '\t';
+        lines += createFen();
+        lines += '\t' + std::to_string(fen_ply + ply) + '\t' + std::to_string(game_id) + '\t' + results[result] + '\n';
+    }
+
+    /**
+     * Reset the PGN parser, see pgnFeed
+     * @param create_fen add the FEN of each move
+     */
+    void pgnReset(bool create_fen) {
+        pgn_buffer.clear();
+        pgn_comment = false;
+        pgn_create_fen = create_fen;
+        pgn_depth = 0;
+        pgn_evals.clear();
+        pgn_fen.clear();
+        memset(pgn_game, 0, sizeof(pgn_game));
+        pgn_games.clear();
+        pgn_state = 0;
+        replay_moves.clear();
+        replay_text.clear();
+    }
+
+    /**
+     * Generate the bitbases that can be reached from the current material, done before a search
+     * - bitbase_mode 1: up to 3 pieces, 2: up to 4 pieces, kings included
+     * - the weak side loses all its pieces, the extra pawns of the strong side can promote
+     * - a bitbase needing more captures is only used if it was already generated
+     * @param max_capture captures available to reach a bitbase, ex: search depth
+     */
+    void prepareBitbases(int max_capture) {
+        if (!bitbase_mode)
+            return;
+
+        auto num_piece = 0;
+        for (auto key = material_key; key; key >>= 4)
+            num_piece += key & 15;
+
+        // KQK, KQQK, KQRK, ... KPPK: first <= second, second = 5 => 1 piece
+        static const char *letters = "QRBNP";
+        for (auto first = 0; first < 5; first ++) {
+            for (auto second = first; second < 6; second ++) {
+                auto size = (second < 5)? 2: 1;
+                if (size > bitbase_mode)
+                    continue;
+                std::string code = "K";
+                code += letters[first];
+                if (second < 5)
+                    code += letters[second];
+                code += 'K';
+
+                for (auto color = 0; color < 2; color ++) {
+                    int needs[8] = {0};
+                    uint64_t key = 0;
+                    for (auto i = 1; i <= size; i ++) {
+                        auto type = TYPE(pieceCode(code[i]));
+                        needs[type] ++;
+                        key += MaterialUnit(COLORIZE(color, type));
+                    }
+                    if (bitbase_cache.find(key) != bitbase_cache.end())
+                        continue;
+
+                    // the missing pieces come from the extra pawns
+                    auto pawns = MaterialCount(material_key, COLORIZE(color, PAWN)) - needs[PAWN];
+                    for (auto type = KNIGHT; type <= QUEEN; type ++)
+                        pawns -= Max(0, needs[type] - MaterialCount(material_key, COLORIZE(color, type)));
+                    if (pawns < 0)
+                        continue;
+
+                    auto bitbase = findBitbase(code, num_piece - size <= max_capture);
+                    if (bitbase)
+                        bitbase_cache[key] = bitbase;
+                }
+            }
+        }
+    }
+
     /**
      * Process the move + pv strings
      * @param move_string list of numbers
@@ -2271,15 +5212,36 @@ public:
         return text;
     }
 
+    /**
+     * Probe the current position in the bitbases
+     * - only the bitbases of prepareBitbases are used, nothing is generated during a search
+     * @return 1:win, 0:draw, -1:loss for the side to move, SCORE_NONE if unknown
+     */
+    int probeBitbase() {
+        if (!bitbase_mode)
+            return SCORE_NONE;
+        if (!material_key)
+            return 0;
+
+        auto it = bitbase_cache.find(material_key);
+        if (it == bitbase_cache.end())
+            return SCORE_NONE;
+        return probeBoard(0, it->second);
+    }
+
     /**
      * Put a piece on a square
      */
     void put(Piece piece, Square square) {
+        attack_ready = false;
         board[square] = piece;
+        fen_dirty |= 1 << Rank(square);
         if (TYPE(piece) == KING)
             kings[COLOR(piece)] = square;
-        else
+        else {
+            material_key += MaterialUnit(piece);
             materials[COLOR(piece)] += PIECE_SCORES[piece];
+        }
     }
 
     /**
@@ -2297,46 +5259,52 @@ public:
      * @param sloppy allow sloppy parser
      */
     MoveText sanToObject(std::string san, std::vector<Move> &moves, bool sloppy) {
-        // 1) try exact matching
         auto clean = cleanSan(san);
-        for (auto &move : moves)
-            if (clean == cleanSan(moveToSan(move, moves))) {
-                auto obj = unpackMove(move);
-                obj.m = san;
-                obj.ply = fen_ply + ply + 1;
-                return obj;
-            }
 
-        // 2) try sloppy matching
-        if (!sloppy)
+        // 1) castle
+        if (clean == "O-O" || clean == "O-O-O") {
+            for (auto &move : moves)
+                if ((MoveFlag(move) & BITS_CASTLE) && (MoveTo(move) > MoveFrom(move)) == (clean.size() == 3)) {
+                    auto obj = unpackMove(move);
+                    obj.m = san;
+                    obj.ply = fen_ply + ply + 1;
+                    return obj;
+                }
             return NULL_OBJ;
+        }
 
+        // 2) decode the fields, analysing backwards
+        // strict = the text could have been generated by moveToSan
+        auto capture = false;
         auto from_file = EMPTY,
             from_rank = EMPTY;
+        int i = clean.size() - 1;
         Piece promote = 0;
+        auto strict = true;
         auto to = EMPTY;
         Piece type = 0;
 
-        auto i = clean.size() - 1;
-        if (i < 2)
+        if (i < 1)
             return NULL_OBJ;
-
-        // analyse backwards
         if (strchr("bnrqBNRQ", clean[i])) {
-            promote = TYPE(PIECES[clean[i]]);
+            promote = TYPE(pieceCode(clean[i]));
+            strict = (clean[i] < 'a');
             i --;
         }
         // to
-        if (clean[i] < '1' || clean[i] > '8')
+        if (i < 1 || clean[i] < '1' || clean[i] > '8')
             return NULL_OBJ;
-        i --;
-        if (clean[i] < 'a' || clean[i] > 'j')
+        if (clean[i - 1] < 'a' || clean[i - 1] > 'j')
             return NULL_OBJ;
-        to = clean[i] - 'a' + (('8' - clean[i + 1]) << 4);
-        i --;
+        if (clean[i - 1] > 'h')
+            strict = false;
+        to = clean[i - 1] - 'a' + (('8' - clean[i]) << 4);
+        i -= 2;
         //
-        if (i >= 0 && clean[i] == 'x')
+        if (i >= 0 && clean[i] == 'x') {
+            capture = true;
             i --;
+        }
         // from
         if (i >= 0 && clean[i] >= '1' && clean[i] <= '8') {
             from_rank = '8' - clean[i];
@@ -2347,14 +5315,77 @@ public:
             i --;
         }
         // type
-        type = TYPE(PIECES[clean[i]]);
+        if (i >= 0) {
+            type = TYPE(pieceCode(clean[i]));
+            if (i > 0 || !strchr("NBRQK", clean[i]))
+                strict = false;
+        }
 
-        for (auto &move : moves) {
-            auto move_from = MoveFrom(move),
-                move_to = MoveTo(move);
+        // 3) single pass: only the moves ending on the target square are candidates
+        Move candidates[64];
+        auto num_candidate = 0;
+        for (auto &move : moves)
+            if (MoveTo(move) == to && num_candidate < 64)
+                candidates[num_candidate ++] = move;
+
+        // 4) exact matching: the SAN must be the one moveToSan would produce
+        if (strict) {
+            auto piece_type = type? type: PAWN;
+            for (auto j = 0; j < num_candidate; j ++) {
+                auto move = candidates[j];
+                auto move_from = MoveFrom(move);
+                auto piece = board[move_from];
+
+                if ((MoveFlag(move) & BITS_CASTLE) || TYPE(piece) != piece_type || MovePromote(move) != promote
+                        || capture != (MoveCapture(move) || (MoveFlag(move) & BITS_EN_PASSANT))
+                        || (from_file != EMPTY && from_file != Filer(move_from))
+                        || (from_rank != EMPTY && from_rank != Rank(move_from)))
+                    continue;
+
+                // pawn: file only for captures
+                // piece: minimal disambiguation, see disambiguate
+                auto need_file = false,
+                    need_rank = false;
+                if (piece_type == PAWN)
+                    need_file = capture;
+                else {
+                    auto ambiguities = 0,
+                        same_file = 0,
+                        same_rank = 0;
+                    for (auto k = 0; k < num_candidate; k ++) {
+                        auto ambig_from = MoveFrom(candidates[k]);
+                        if (board[ambig_from] == piece && ambig_from != move_from) {
+                            ambiguities ++;
+                            if (Rank(ambig_from) == Rank(move_from))
+                                same_rank ++;
+                            if (Filer(ambig_from) == Filer(move_from))
+                                same_file ++;
+                        }
+                    }
+                    if (ambiguities) {
+                        need_file = (same_rank > 0 || !same_file);
+                        need_rank = (same_file > 0);
+                    }
+                }
+                if (need_file != (from_file != EMPTY) || need_rank != (from_rank != EMPTY))
+                    break;
+
+                auto obj = unpackMove(move);
+                obj.m = san;
+                obj.ply = fen_ply + ply + 1;
+                return obj;
+            }
+        }
+
+        // 5) sloppy matching
+        if (!sloppy || clean.size() < 3)
+            return NULL_OBJ;
+
+        for (auto j = 0; j < num_candidate; j ++) {
+            auto move = candidates[j];
+            auto move_from = MoveFrom(move);
 
-            if (to == move_to
-                    && (!type || type == TYPE(board[move_from]))
+            if ((!type || type == TYPE(board[move_from]))
                     && (from_file == EMPTY || from_file == Filer(move_from))
                     && (from_rank == EMPTY || from_rank == Rank(move_from))
                     && (!promote || promote == MovePromote(move))) {
@@ -2381,6 +5412,11 @@ public:
         hashBoard();
         evaluatePositions();
 
+        // 2) bitbases at the root
+        prepareBitbases(max_extend + max_quiesce);
+        if (eval_mode & 1)
+            filterBitbase();
+
         // 3) search
         PV pv;
         if (search_mode == 1)
@@ -2423,6 +5459,74 @@ public:
         return text;
     }
 
+    /**
+     * Keep the attack map up to date in makeMove + undoMove
+     * - off by default: the moves only mark the map as outdated, it's rebuilt on demand
+     * - worth it when the map is queried after most of the moves
+     * @param track
+     */
+    void trackAttacks(bool track) {
+        attack_track = track;
+    }
+
+    /**
+     * Convert a live PV, reusing the moves shared with the previous call
+     * - only the moves after the common prefix are parsed, from the last shared position
+     * - the full PV is the previous result cut at em_trackPrefix, followed by the returned moves
+     * @param fen_ root position, a different root resets the tracking
+     * @param multi UCI moves: c2c4 a7a8a ...
+     * @returns new moves, same format as multiUci
+     */
+    std::vector<MoveText> trackPv(std::string fen_, std::string multi) {
+        if (fen_ != track_fen) {
+            track_fen = fen_;
+            track_objs.clear();
+            track_ucis.clear();
+        }
+
+        // 1) split the moves and find the common prefix
+        std::vector<std::string> ucis;
+        int prev = 0,
+            size = multi.size();
+        for (int i = 0; i <= size; i ++) {
+            if (i < size && multi[i] != ' ')
+                continue;
+            if (multi[prev] >= 'A')
+                ucis.emplace_back(multi.substr(prev, i - prev));
+            prev = i + 1;
+        }
+
+        int count = ucis.size(),
+            prefix = 0,
+            tracked = track_ucis.size();
+        while (prefix < count && prefix < tracked && ucis[prefix] == track_ucis[prefix])
+            prefix ++;
+
+        track_prefix = prefix;
+        track_objs.resize(prefix);
+        track_ucis.resize(prefix);
+
+        // 2) parse the new moves
+        std::vector<MoveText> result;
+        if (prefix == count)
+            return result;
+
+        load(prefix? track_objs[prefix - 1].fen: track_fen, false);
+        for (auto i = prefix; i < count; i ++) {
+            auto obj = moveUci(ucis[i], true);
+            if (obj.from == obj.to || !obj.m.size())
+                break;
+
+            obj.fen = createFen();
+            obj.ply = fen_ply + ply;
+            obj.score = 0;
+            track_objs.emplace_back(obj);
+            track_ucis.emplace_back(ucis[i]);
+            result.emplace_back(obj);
+        }
+        return result;
+    }
+
     /**
      * Get the UCI of a move number
      */
@@ -2454,8 +5558,8 @@ public:
             return false;
         ply --;
 
-        auto &state = ply_states[ply & 127];
-        board_hash = state.hash;
+        auto &state = ply_states[ply];
+        board_hash = ply_hashes[ply];
         memcpy(castling, state.castling, sizeof(castling));
         ep_square = state.ep_square;
         half_moves = state.half_moves;
@@ -2478,6 +5582,7 @@ public:
             // null move
             return true;
         }
+        fen_dirty |= (1 << Rank(move_from)) | (1 << Rank(move_to));
 
         // undo castle
         if (move_flag & BITS_CASTLE) {
@@ -2494,147 +5599,1842 @@ public:
             board[move_to] = rook_piece;
             kings[us] = king;
 
+            if (!attack_track)
+                attack_ready = false;
+            else if (attack_ready) {
+                Square changes[4] = {(Square)king_to, (Square)rook_to, king, move_to};
+                Piece befores[4] = {king_piece, rook_piece, 0, 0};
+                updateAttacks(changes, befores, 4);
+            }
+
             // score
             positions[us]
                 += squares[KING][king] - squares[KING][king_to]
                 + squares[ROOK][move_to] - squares[ROOK][rook_to]
                 - 30;
         }
-        else {
-            auto piece = board[move_to];
-            if (promote) {
-                piece = COLORIZE(us, PAWN);
-                materials[us] -= PROMOTE_SCORES[promote];
+        else {
+            auto piece = board[move_to],
+                piece_to = piece;
+            if (promote) {
+                material_key -= MaterialUnit(COLORIZE(us, promote)) - MaterialUnit(COLORIZE(us, PAWN));
+                piece = COLORIZE(us, PAWN);
+                materials[us] -= PROMOTE_SCORES[promote];
+            }
+            board[move_to] = 0;
+            board[move_from] = piece;
+
+            auto piece_type = TYPE(piece);
+            if (piece_type == KING)
+                kings[us] = move_from;
+
+            if (move_flag & BITS_EN_PASSANT) {
+                auto capture = COLORIZE(them, PAWN);
+                Square target = move_to + 16 - (us << 5);
+                board[target] = capture;
+                material_key += MaterialUnit(capture);
+                materials[them] += PIECE_SCORES[PAWN];
+            }
+            else if (move_capture) {
+                auto capture = COLORIZE(them, move_capture);
+                board[move_to] = capture;
+                material_key += MaterialUnit(capture);
+                materials[them] += PIECE_SCORES[move_capture];
+            }
+
+            if (!attack_track)
+                attack_ready = false;
+            else if (attack_ready) {
+                Square changes[3] = {move_to, move_from, (Square)(move_to + 16 - (us << 5))};
+                Piece befores[3] = {piece_to, 0, 0};
+                updateAttacks(changes, befores, (move_flag & BITS_EN_PASSANT)? 3: 2);
+            }
+
+            // score
+            auto psquares = squares[piece_type];
+            positions[turn] += psquares[move_from] - psquares[move_to];
+        }
+
+        return true;
+    }
+
+    /**
+     * Unpack a move to an object
+     * - 0-9 : order
+     * - 10-12 : capture
+     * - 13-14 : flag
+     * - 15-21 : from
+     * - 22-24 : promote
+     * - 25-31 : to
+     */
+    MoveText unpackMove(Move move) {
+        return {
+            MoveCapture(move),
+            MoveFlag(move),
+            MoveFrom(move),
+            MovePromote(move),
+            static_cast<int>(move & 1023),
+            MoveTo(move),
+        };
+    }
+
+#ifdef __EMSCRIPTEN__
+    // EMSCRIPTEN INTERFACES
+    ////////////////////////
+
+    val em_agreeLengths() {
+        auto &lengths = agreeLengths();
+        return val(typed_memory_view(lengths.size(), lengths.data()));
+    }
+
+    /**
+     * Attack map: number of attackers per color + square, a8 = 0, white first
+     * - rebuilt from scratch on the first query after a move, unless trackAttacks(true) was called
+     * - the search does not query it => tracking stays off by default
+     */
+    val em_attackMap() {
+        if (!attack_ready)
+            computeAttacks();
+        return val(typed_memory_view(128, &attack_map[0][0]));
+    }
+
+    val em_attacks() {
+        return val(typed_memory_view(16, attacks));
+    }
+
+    int em_avgDepth() {
+        return max_depth;
+    }
+
+    val em_board() {
+        return val(typed_memory_view(128, board));
+    }
+
+    int32_t em_boardHash() {
+        return (int32_t)board_hash;
+    }
+
+    val em_castling() {
+        return val(typed_memory_view(4, castling));
+    }
+
+    bool em_checked(int color) {
+        return kingAttacked(color);
+    }
+
+    val em_comments(std::string name) {
+        if (name == "depth")
+            return val(typed_memory_view(comment_depths.size(), comment_depths.data()));
+        if (name == "eval")
+            return val(typed_memory_view(comment_evals.size(), comment_evals.data()));
+        if (name == "node")
+            return val(typed_memory_view(comment_nodes.size(), comment_nodes.data()));
+        if (name == "ply")
+            return val(typed_memory_view(comment_plies.size(), comment_plies.data()));
+        if (name == "pv")
+            return val(typed_memory_view(comment_pvs.size(), comment_pvs.data()));
+        if (name == "sel_depth")
+            return val(typed_memory_view(comment_sel_depths.size(), comment_sel_depths.data()));
+        if (name == "speed")
+            return val(typed_memory_view(comment_speeds.size(), comment_speeds.data()));
+        if (name == "tbhit")
+            return val(typed_memory_view(comment_tbhits.size(), comment_tbhits.data()));
+        if (name == "time")
+            return val(typed_memory_view(comment_times.size(), comment_times.data()));
+        if (name == "time_left")
+            return val(typed_memory_view(comment_time_lefts.size(), comment_time_lefts.data()));
+        return val(typed_memory_view(comment_text.size(), (uint8_t *)comment_text.data()));
+    }
+
+    val em_defenses() {
+        return val(typed_memory_view(16, defenses));
+    }
+
+    val em_encodeGame(std::string headers, std::string multi, int result, std::string evals, std::string depths, std::string times) {
+        game_data = encodeGame(headers, multi, result, evals, depths, times);
+        return val(typed_memory_view(game_data.size(), (uint8_t *)game_data.data()));
+    }
+
+    int em_evaluate() {
+        prepareBitbases(0);
+        return evaluate();
+    }
+
+    val em_evaluateBatch(std::string data, bool packed, int quiesce_depth, int num_thread) {
+        batch_scores = evaluateBatch(data, packed, quiesce_depth, num_thread);
+        return val(typed_memory_view(batch_scores.size(), batch_scores.data()));
+    }
+
+    std::string em_fen() {
+        return fen;
+    }
+
+    bool em_frc() {
+        return frc;
+    }
+
+    val em_gameColumns() {
+        return val(typed_memory_view(game_columns.size(), game_columns.data()));
+    }
+
+    std::vector<int> em_hashStats() {
+        return {tt_adds, tt_hits};
+    }
+
+    val em_infos() {
+        return val(typed_memory_view(info_records.size(), info_records.data()));
+    }
+
+    int em_material(int color) {
+        return materials[color];
+    }
+
+    val em_mobilities() {
+        return val(typed_memory_view(16, mobilities));
+    }
+
+    int em_nodes() {
+        return nodes;
+    }
+
+    val em_packPosition() {
+        packed_position = packPosition();
+        return val(typed_memory_view(packed_position.size(), (uint8_t *)packed_position.data()));
+    }
+
+    Piece em_piece(std::string text) {
+        if (text.size() != 1)
+            return 0;
+        return pieceCode(text.at(0));
+    }
+
+    val em_pgnGames() {
+        return val(typed_memory_view(pgn_games.size(), pgn_games.data()));
+    }
+
+    val em_plyHashes() {
+        return val(typed_memory_view(ply, ply_hashes.data()));
+    }
+
+    int em_probe() {
+        prepareBitbases(0);
+        return probeBitbase();
+    }
+
+    val em_replayMoves() {
+        return val(typed_memory_view(replay_moves.size(), replay_moves.data()));
+    }
+
+    val em_replayText() {
+        return val(typed_memory_view(replay_text.size(), (uint8_t *)replay_text.data()));
+    }
+
+    int em_selDepth() {
+        return Max(avg_depth, sel_depth);
+    }
+
+    std::string em_signature() {
+        std::string text;
+        for (auto color = 0; color < 2; color ++) {
+            text += 'K';
+            for (auto type = QUEEN; type >= PAWN; type --)
+                text.append(MaterialCount(material_key, COLORIZE(color, type)), PIECE_UPPER[type]);
+        }
+        return text;
+    }
+
+    val em_trace() {
+        return val(typed_memory_view(TRACE_SIZE * 2, &trace[0][0]));
+    }
+
+    int em_trackPrefix() {
+        return track_prefix;
+    }
+
+    int em_turn() {
+        return turn;
+    }
+
+    bool em_unpackPosition(std::string data) {
+        if (data.size() != PACKED_SIZE || !unpackPosition((const uint8_t *)data.data()))
+            return false;
+        hashBoard();
+        return true;
+    }
+
+    std::string em_version() {
+        return "20201102";
+    }
+#endif
+};
+
+// polyglot opening book
+// - the moves are generated on the board of a Chess instance, its position is replaced
+class Book {
+private:
+    Chess       &chess;
+    std::string buffer;                         // built or loaded book, see build
+    std::vector<BookEntry> entries;             // see add
+    std::string_view view;                      // buffer or a memory mapped file
+
+    /**
+     * Polyglot key of the current position
+     * - pieces: 64 * kind + 8 * row + file, kind = 2 * (type - 1) + white, row 0 = 1st rank
+     * - castling: 768 + KQkq, en passant: 772 + file if a pawn can capture, white to move: 780
+     * @returns key
+     */
+    Hash polyglotKey() {
+        Hash key = 0;
+        for (auto square = SQUARE_A8; square <= SQUARE_H1; square ++) {
+            if (square & 0x88) {
+                square += 7;
+                continue;
+            }
+            auto piece = chess.board[square];
+            if (piece) {
+                auto kind = ((TYPE(piece) - 1) << 1) + (COLOR(piece) ^ 1);
+                key ^= POLYGLOT_RANDOMS[(kind << 6) + ((7 - Rank(square)) << 3) + Filer(square)];
+            }
+        }
+        for (auto id = 0; id < 4; id ++)
+            if (chess.castling[id] != EMPTY)
+                key ^= POLYGLOT_RANDOMS[768 + id];
+        if (chess.ep_square != EMPTY) {
+            for (auto delta : {15, 17}) {
+                Square square = chess.ep_square + (chess.turn? -delta: delta);
+                if (!(square & 0x88) && chess.board[square] == COLORIZE(chess.turn, PAWN)) {
+                    key ^= POLYGLOT_RANDOMS[772 + Filer(chess.ep_square)];
+                    break;
+                }
+            }
+        }
+        if (chess.turn == WHITE)
+            key ^= POLYGLOT_RANDOMS[780];
+        return key;
+    }
+
+    /**
+     * Polyglot move: to file, to row, from file, from row, promotion (1:N to 4:Q), 3 bits each
+     * - castle is king x rook, same as the FRC moves here
+     */
+    uint16_t polyglotMove(Square from, Square to, Piece promote) {
+        return Filer(to) + ((7 - Rank(to)) << 3) + (Filer(from) << 6) + ((7 - Rank(from)) << 9)
+            + ((promote? promote - 1: 0) << 12);
+    }
+
+public:
+    Book(Chess &chess_): chess(chess_) {}
+
+    /**
+     * Add the moves of a PGN text to the opening book, see build
+     * - weight: 2 if the side to move won, 1 for a draw, 0 for a loss, unfinished games are skipped
+     * - replaces the position of the board, like Chess::pgnGame
+     * @param pgn complete games
+     * @param max_ply moves per game
+     * @returns number of games
+     */
+    int add(std::string pgn, int max_ply) {
+        chess.pgnReset(false);
+        int num_game = chess.pgnFeed(pgn, true);
+        for (auto i = 0; i < num_game; i ++) {
+            auto record = chess.pgnGame(i);
+            auto result = record[4];
+            if (!result)
+                continue;
+
+            auto num_move = Min(record[3], max_ply);
+            for (auto j = 0; j < num_move; j ++)
+                addMove(record[2] + j, result);
+        }
+        return num_game;
+    }
+
+    /**
+     * Add a parsed PGN move of the board to the opening book, then play it, see add
+     * @param id move in Chess::replay_moves
+     * @param result 1:1-0, 2:0-1, 3:1/2-1/2
+     */
+    void addMove(int id, int result) {
+        auto data = &chess.replay_moves[id * REPLAY_SIZE];
+        uint32_t weight = (result == 3)? 1: ((result == 1) == (chess.turn == WHITE))? 2: 0;
+        entries.push_back({polyglotKey(), polyglotMove(data[0], data[1], data[4]), weight});
+        chess.replayMove(id);
+    }
+
+    /**
+     * Use a polyglot book without copying it, ex: memory mapped file
+     * @param data must stay valid while the book is used
+     * @param size
+     * @returns number of entries, -1 if invalid
+     */
+    int attach(const char *data, size_t size) {
+        if (size & 15) {
+            view = std::string_view();
+            return -1;
+        }
+        view = std::string_view(data, size);
+        return size >> 4;
+    }
+
+    /**
+     * Build a polyglot book from the entries, then clear them
+     * - 16 bytes per entry, big endian: u64 key, u16 move, u16 weight, u32 learn
+     * - sorted by key, the moves with a weight of 0 are dropped
+     * - the weights of a position are scaled down if the best one exceeds 65535
+     * @returns book
+     */
+    const std::string &build() {
+        std::sort(entries.begin(), entries.end());
+        std::vector<BookEntry> merged;
+        for (auto &entry : entries) {
+            if (merged.size() && merged.back().key == entry.key && merged.back().move == entry.move)
+                merged.back().weight += entry.weight;
+            else
+                merged.push_back(entry);
+        }
+
+        buffer.clear();
+        size_t start = 0;
+        while (start < merged.size()) {
+            auto end = start;
+            uint32_t best = 0;
+            for (; end < merged.size() && merged[end].key == merged[start].key; end ++)
+                best = std::max(best, merged[end].weight);
+
+            for (auto i = start; i < end; i ++) {
+                auto &entry = merged[i];
+                uint32_t weight = (best > 65535)? (uint64_t)entry.weight * 65535 / best: entry.weight;
+                if (!weight)
+                    continue;
+                for (auto shift = 56; shift >= 0; shift -= 8)
+                    buffer += (char)((entry.key >> shift) & 255);
+                buffer += (char)(entry.move >> 8);
+                buffer += (char)(entry.move & 255);
+                buffer += (char)(weight >> 8);
+                buffer += (char)(weight & 255);
+                buffer.append(4, 0);
+            }
+            start = end;
+        }
+
+        entries.clear();
+        entries.shrink_to_fit();
+        attach(buffer.data(), buffer.size());
+        return buffer;
+    }
+
+    /**
+     * Move the book entries of another instance, ex: 1 instance per thread
+     * @param other
+     */
+    void merge(Book &other) {
+        entries.insert(entries.end(), other.entries.begin(), other.entries.end());
+        other.entries.clear();
+    }
+
+    /**
+     * Get the book moves of a position
+     * - loads the FEN: the position of the board is replaced, like Chess::load
+     * @param fen_
+     * @returns legal moves, the weight is in score, in book order
+     */
+    std::vector<MoveText> moves(std::string fen_) {
+        std::vector<MoveText> objs;
+        chess.load(fen_, false);
+        auto key = polyglotKey();
+
+        // 1) binary search on the key
+        auto data = (const uint8_t *)view.data();
+        auto readKey = [&](size_t id) {
+            Hash value = 0;
+            for (auto i = 0; i < 8; i ++)
+                value = (value << 8) | data[(id << 4) + i];
+            return value;
+        };
+        size_t left = 0,
+            right = view.size() >> 4;
+        while (left < right) {
+            auto middle = (left + right) >> 1;
+            if (readKey(middle) < key)
+                left = middle + 1;
+            else
+                right = middle;
+        }
+
+        // 2) entries => legal moves
+        auto moves = chess.legalMoves();
+        for (auto id = left; id < (view.size() >> 4) && readKey(id) == key; id ++) {
+            auto entry = data + (id << 4) + 8;
+            int move = (entry[0] << 8) + entry[1],
+                weight = (entry[2] << 8) + entry[3];
+            Square from = ((7 - ((move >> 9) & 7)) << 4) + ((move >> 6) & 7),
+                to = ((7 - ((move >> 3) & 7)) << 4) + (move & 7);
+            Piece promote = (move >> 12) & 7;
+            if (promote)
+                promote ++;
+
+            for (auto legal : moves) {
+                if (MoveFrom(legal) != from || MoveTo(legal) != to || MovePromote(legal) != promote)
+                    continue;
+                auto obj = chess.unpackMove(legal);
+                obj.m = chess.moveToSan(legal, moves);
+                chess.makeMove(legal);
+                obj.m = chess.decorateSan(obj.m);
+                chess.undoMove();
+                obj.score = weight;
+                objs.push_back(obj);
+                break;
+            }
+        }
+        return objs;
+    }
+
+    /**
+     * Pick a book move, the probability is proportional to the weight
+     * - loads the FEN: the position of the board is replaced, see moves
+     * @param fen_
+     * @param random in [0, 1[
+     * @returns move, from == to if there's none
+     */
+    MoveText pick(std::string fen_, double random) {
+        auto objs = moves(fen_);
+        int total = 0;
+        for (auto &obj : objs)
+            total += obj.score;
+
+        double target = random * total;
+        for (auto &obj : objs) {
+            target -= obj.score;
+            if (target < 0)
+                return obj;
+        }
+        return objs.size()? objs.back(): NULL_OBJ;
+    }
+#ifdef __EMSCRIPTEN__
+    // EMSCRIPTEN INTERFACES
+    ////////////////////////
+
+    val em_build() {
+        auto &data = build();
+        return val(typed_memory_view(data.size(), (uint8_t *)data.data()));
+    }
+
+    std::string em_key(std::string fen_) {
+        char hex[20];
+        chess.load(fen_, false);
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)polyglotKey());
+        return hex;
+    }
+
+    int em_load(std::string data) {
+        buffer = data;
+        return attach(buffer.data(), buffer.size());
+    }
+#endif
+};
+
+// ECO classification of the openings
+// - the moves are generated on the board of a Chess instance, its position is replaced
+class Eco {
+private:
+    Chess       &chess;
+    std::vector<std::string> names;             // "ECO\tName" per opening line, see load
+    std::vector<std::pair<Hash, int>> table;    // sorted openingKey => line
+
+    /**
+     * Look up the current position in the opening lines
+     * @returns line index, -1 if not found
+     */
+    int probe() {
+        auto key = chess.openingKey();
+        auto it = std::lower_bound(table.begin(), table.end(), std::make_pair(key, -1));
+        return (it != table.end() && it->first == key)? it->second: -1;
+    }
+
+public:
+    Eco(Chess &chess_): chess(chess_) {}
+
+    /**
+     * Find the opening of a game: deepest position that matches an opening line, 1 probe per ply
+     * - transpositions are recognized since the lookup is by position
+     * @param fen_ start position, empty for the default
+     * @param multi SAN moves, move numbers + annotations are skipped: 1. e4 e5 2. Nf3!?
+     * @returns line index, see name, -1 if not found
+     */
+    int classify(std::string fen_, std::string multi) {
+        chess.load(fen_.size()? fen_: DEFAULT_POSITION, true);
+        auto best = probe();
+
+        std::string san;
+        int prev = 0,
+            size = multi.size();
+        for (int i = 0; i <= size; i ++) {
+            if (i < size && multi[i] != ' ')
+                continue;
+            auto token = std::string_view(multi).substr(prev, i - prev);
+            prev = i + 1;
+            if (token.empty() || chess.pgnSan(token, san) >= 0 || san.empty())
+                continue;
+
+            auto moves = chess.legalMoves();
+            auto obj = chess.sanToObject(san, moves, true);
+            if (obj.from == obj.to)
+                break;
+            chess.makeMove(chess.packObject(obj));
+            auto id = probe();
+            if (id >= 0)
+                best = id;
+        }
+        return best;
+    }
+
+    /**
+     * Find the openings of all the games of a PGN text, see classify
+     * @param pgn complete games
+     * @returns line index per game, -1 if not found
+     */
+    std::vector<int> games(std::string pgn) {
+        std::vector<int> ids;
+        chess.pgnReset(false);
+        int num_game = chess.pgnFeed(pgn, true);
+        for (auto i = 0; i < num_game; i ++) {
+            auto record = chess.pgnGame(i);
+            auto best = probe();
+            for (auto j = 0; j < record[3]; j ++) {
+                chess.replayMove(record[2] + j);
+                auto id = probe();
+                if (id >= 0)
+                    best = id;
+            }
+            ids.push_back(best);
+        }
+        return ids;
+    }
+
+    /**
+     * Load opening lines, can be called several times
+     * - 1 line per opening: ECO, name, SAN moves separated by tabs, ex: "C60\tRuy Lopez\t1. e4 e5 2. Nf3 Nc6 3. Bb5"
+     * - the lines with an invalid move are skipped, ex: a header line
+     * - if several lines reach the same position, the first one is kept
+     * @param text
+     * @returns number of lines loaded
+     */
+    int load(std::string text) {
+        std::string_view view(text);
+        std::string san;
+        int count = 0;
+        size_t start = 0;
+        while (start < view.size()) {
+            auto end = view.find('\n', start);
+            if (end == std::string_view::npos)
+                end = view.size();
+            auto line = view.substr(start, end - start);
+            start = end + 1;
+            if (line.size() && line.back() == '\r')
+                line.remove_suffix(1);
+
+            auto tab = line.find('\t'),
+                tab2 = line.find('\t', tab + 1);
+            if (tab == std::string_view::npos || tab2 == std::string_view::npos)
+                continue;
+
+            // replay the moves
+            chess.load(DEFAULT_POSITION, true);
+            auto moves_text = line.substr(tab2 + 1);
+            auto valid = true;
+            size_t prev = 0;
+            for (size_t i = 0; i <= moves_text.size() && valid; i ++) {
+                if (i < moves_text.size() && moves_text[i] != ' ')
+                    continue;
+                auto token = moves_text.substr(prev, i - prev);
+                prev = i + 1;
+                if (token.empty() || chess.pgnSan(token, san) >= 0 || san.empty())
+                    continue;
+
+                auto moves = chess.legalMoves();
+                auto obj = chess.sanToObject(san, moves, true);
+                if (obj.from == obj.to)
+                    valid = false;
+                else
+                    chess.makeMove(chess.packObject(obj));
+            }
+            if (!valid || !chess.ply)
+                continue;
+
+            table.emplace_back(chess.openingKey(), names.size());
+            names.emplace_back(line.substr(0, tab2));
+            count ++;
+        }
+
+        // first line per position
+        std::stable_sort(table.begin(), table.end(), [](auto &a, auto &b) {return a.first < b.first;});
+        table.erase(std::unique(table.begin(), table.end(), [](auto &a, auto &b) {return a.first == b.first;}), table.end());
+        return count;
+    }
+
+    /**
+     * Get the ECO + name of an opening line
+     * @param id line index, see classify
+     * @returns "ECO\tName", empty if invalid
+     */
+    std::string name(int id) {
+        return (id >= 0 && id < (int)names.size())? names[id]: "";
+    }
+
+    /**
+     * Clear the opening lines
+     */
+    void reset() {
+        names.clear();
+        table.clear();
+    }
+};
+
+// opening explorer: statistics of the moves played from each position
+// - the moves are generated on the board of a Chess instance, its position is replaced
+class Explorer {
+private:
+    Chess       &chess;
+    std::string buffer;                         // owned explorer, see build
+    std::vector<double> results;                // EXPLORER_SIZE values per move, see query
+    std::vector<Explore> rows;                  // new rows, merged by build
+    std::string_view view;                      // explorer used by query: buffer or mapped
+
+public:
+    Explorer(Chess &chess_): chess(chess_) {}
+
+    /**
+     * Add the games of a PGN text to the opening explorer, see build
+     * - 1 row per position + move, up to max_ply moves from the start of each game
+     * - the eval is the wv= of the comment after the move
+     * @param pgn complete games
+     * @param max_ply
+     * @returns number of games
+     */
+    int add(std::string pgn, int max_ply) {
+        chess.pgnReset(false);
+        int num_game = chess.pgnFeed(pgn, true);
+        for (auto i = 0; i < num_game; i ++) {
+            auto record = chess.pgnGame(i);
+            auto result = record[4];
+            auto num_move = Min(record[3], max_ply);
+            for (auto j = 0; j < num_move; j ++) {
+                auto id = record[2] + j;
+                auto data = &chess.replay_moves[id * REPLAY_SIZE];
+                Explore row = {chess.openingKey(), (uint32_t)(data[0] + (data[1] << 8) + (data[4] << 16)), {1, 0, 0, 0}, 0, 0};
+                if (result)
+                    row.counts[(result == 3)? 2: (result == 1)? 1: 3] = 1;
+                auto eval = chess.pgn_evals[id];
+                if (std::isfinite(eval)) {
+                    row.num_eval = 1;
+                    row.sum_eval = eval;
+                }
+                rows.push_back(row);
+                chess.replayMove(id);
+            }
+        }
+        return num_game;
+    }
+
+    /**
+     * Use an explorer without copying it, ex: memory mapped file
+     * @param data must stay valid while the explorer is used
+     * @param size
+     * @returns number of rows, -1 if invalid
+     */
+    int attach(const char *data, size_t size) {
+        view = std::string_view(data, size);
+        auto bytes = (const uint8_t *)data;
+        if (size < INDEX_HEADER || readLittle(bytes, 4) != EXPLORER_MAGIC
+                || size < INDEX_HEADER + readLittle(bytes + 4, 4) * 16 + readLittle(bytes + 8, 4) * EXPLORER_ROW) {
+            view = std::string_view();
+            return -1;
+        }
+        return readLittle(bytes + 8, 4);
+    }
+
+    /**
+     * Merge the new rows into the explorer, then clear them
+     * - the rows of the current explorer are kept => games can be added to a loaded explorer
+     * - header: u32 magic TPEX, u32 number of positions, u32 number of rows, u32 0
+     * - positions: u64 openingKey, u32 offset of the first row, u32 number of rows, sorted by key
+     * - rows, most played first: u8 from, to, promote, 0, u32 games, white wins, draws, black wins,
+     *   u32 number of evals, f64 sum of the evals
+     * - little endian, can be memory mapped as is, see attach
+     * @returns explorer
+     */
+    const std::string &build() {
+        // 1) unpack the current explorer
+        auto data = (const uint8_t *)view.data();
+        int num_key = view.size()? readLittle(data + 4, 4): 0;
+        for (auto i = 0; i < num_key; i ++) {
+            auto entry = data + INDEX_HEADER + i * 16;
+            auto bytes = data + readLittle(entry + 8, 4);
+            int count = readLittle(entry + 12, 4);
+            for (auto j = 0; j < count; j ++, bytes += EXPLORER_ROW) {
+                Explore row = {readLittle(entry, 8), (uint32_t)(bytes[0] + (bytes[1] << 8) + (bytes[2] << 16)), {0}, 0, 0};
+                for (auto k = 0; k < 4; k ++)
+                    row.counts[k] = readLittle(bytes + 4 + k * 4, 4);
+                row.num_eval = readLittle(bytes + 20, 4);
+                auto bits = readLittle(bytes + 24, 8);
+                memcpy(&row.sum_eval, &bits, 8);
+                rows.push_back(row);
+            }
+        }
+
+        // 2) same hash + move => 1 row
+        std::sort(rows.begin(), rows.end());
+        size_t last = 0;
+        for (size_t i = 1; i < rows.size(); i ++) {
+            auto &row = rows[i];
+            auto &prev = rows[last];
+            if (row.hash == prev.hash && row.move == prev.move) {
+                for (auto j = 0; j < 4; j ++)
+                    prev.counts[j] += row.counts[j];
+                prev.num_eval += row.num_eval;
+                prev.sum_eval += row.sum_eval;
+            }
+            else if (++ last != i)
+                rows[last] = row;
+        }
+        if (rows.size())
+            rows.resize(last + 1);
+
+        // 3) positions, with their moves sorted by games
+        std::vector<size_t> starts;
+        for (size_t i = 0; i < rows.size(); i ++)
+            if (!i || rows[i].hash != rows[i - 1].hash)
+                starts.push_back(i);
+        starts.push_back(rows.size());
+        num_key = starts.size() - 1;
+
+        buffer.clear();
+        writeLittle(buffer, EXPLORER_MAGIC, 4);
+        writeLittle(buffer, num_key, 4);
+        writeLittle(buffer, rows.size(), 4);
+        writeLittle(buffer, 0, 4);
+        auto offset = INDEX_HEADER + num_key * 16;
+        for (auto i = 0; i < num_key; i ++) {
+            writeLittle(buffer, rows[starts[i]].hash, 8);
+            writeLittle(buffer, offset + starts[i] * EXPLORER_ROW, 4);
+            writeLittle(buffer, starts[i + 1] - starts[i], 4);
+        }
+        for (auto i = 0; i < num_key; i ++) {
+            std::stable_sort(rows.begin() + starts[i], rows.begin() + starts[i + 1], [](const Explore &a, const Explore &b) {
+                return a.counts[0] > b.counts[0];
+            });
+            for (auto j = starts[i]; j < starts[i + 1]; j ++) {
+                auto &row = rows[j];
+                writeLittle(buffer, row.move, 4);
+                for (auto k = 0; k < 4; k ++)
+                    writeLittle(buffer, row.counts[k], 4);
+                writeLittle(buffer, row.num_eval, 4);
+                uint64_t bits;
+                memcpy(&bits, &row.sum_eval, 8);
+                writeLittle(buffer, bits, 8);
+            }
+        }
+
+        rows.clear();
+        rows.shrink_to_fit();
+        attach(buffer.data(), buffer.size());
+        return buffer;
+    }
+
+    /**
+     * Statistics of the moves played from a position, most played first
+     * - EXPLORER_SIZE values per move: from, to, promote, games, white wins, draws, black wins, average eval
+     * - average eval: NAN if no eval
+     * @param fen_
+     * @returns number of moves, see results
+     */
+    int query(std::string fen_) {
+        results.clear();
+        if (view.size() < INDEX_HEADER)
+            return 0;
+        chess.load(fen_, true);
+        auto hash = chess.openingKey();
+
+        auto data = (const uint8_t *)view.data();
+        int left = 0,
+            right = readLittle(data + 4, 4);
+        while (left < right) {
+            auto middle = (left + right) >> 1;
+            if (readLittle(data + INDEX_HEADER + middle * 16, 8) < hash)
+                left = middle + 1;
+            else
+                right = middle;
+        }
+        auto entry = data + INDEX_HEADER + left * 16;
+        if (left >= (int)readLittle(data + 4, 4) || readLittle(entry, 8) != hash)
+            return 0;
+
+        auto bytes = data + readLittle(entry + 8, 4);
+        int count = readLittle(entry + 12, 4);
+        for (auto i = 0; i < count; i ++, bytes += EXPLORER_ROW) {
+            int num_eval = readLittle(bytes + 20, 4);
+            auto bits = readLittle(bytes + 24, 8);
+            double sum_eval;
+            memcpy(&sum_eval, &bits, 8);
+            results.insert(results.end(), {
+                (double)bytes[0],
+                (double)bytes[1],
+                (double)bytes[2],
+                (double)readLittle(bytes + 4, 4),
+                (double)readLittle(bytes + 8, 4),
+                (double)readLittle(bytes + 12, 4),
+                (double)readLittle(bytes + 16, 4),
+                num_eval? sum_eval / num_eval: NAN,
+            });
+        }
+        return count;
+    }
+
+    /**
+     * Clear the opening explorer
+     */
+    void reset() {
+        buffer.clear();
+        results.clear();
+        rows.clear();
+        view = std::string_view();
+    }
+
+#ifdef __EMSCRIPTEN__
+    // EMSCRIPTEN INTERFACES
+    ////////////////////////
+
+    val em_build() {
+        auto &data = build();
+        return val(typed_memory_view(data.size(), (uint8_t *)data.data()));
+    }
+
+    int em_load(std::string data) {
+        buffer = data;
+        return attach(buffer.data(), buffer.size());
+    }
+
+    val em_results() {
+        return val(typed_memory_view(results.size(), results.data()));
+    }
+#endif
+};
+
+// position index: games + plies that reached a position
+// - the moves are generated on the board of a Chess instance, its position is replaced
+class Index {
+private:
+    Chess       &chess;
+    std::string buffer;                         // built or loaded index, see build
+    std::vector<int32_t> matches;               // game + ply per match, see query
+    std::vector<Posting> postings;              // see add
+    std::string_view view;                      // buffer or a memory mapped file
+
+public:
+    Index(Chess &chess_): chess(chess_) {}
+
+    /**
+     * Add the positions of a PGN text to the index, see build
+     * - the start positions are not included
+     * - keyed by openingKey => a useless en passant square does not hide a transposition
+     * @param pgn complete games
+     * @param game_id id of the first game
+     * @returns number of games
+     */
+    int add(std::string pgn, int game_id) {
+        chess.pgnReset(false);
+        int num_game = chess.pgnFeed(pgn, true);
+        for (auto i = 0; i < num_game; i ++, game_id ++) {
+            auto record = chess.pgnGame(i);
+            for (auto j = 0; j < record[3]; j ++) {
+                chess.replayMove(record[2] + j);
+                addPosition(game_id);
+            }
+        }
+        return num_game;
+    }
+
+    /**
+     * Add the position of the board to the index, see add
+     * @param game_id
+     */
+    void addPosition(int game_id) {
+        postings.push_back({chess.openingKey(), game_id, chess.fen_ply + chess.ply});
+    }
+
+    /**
+     * Use an index without copying it, ex: memory mapped file
+     * @param data must stay valid while the index is used
+     * @param size
+     * @returns number of postings, -1 if invalid
+     */
+    int attach(const char *data, size_t size) {
+        view = std::string_view(data, size);
+        auto bytes = (const uint8_t *)data;
+        if (size < INDEX_HEADER || readLittle(bytes, 4) != INDEX_MAGIC
+                || size < INDEX_HEADER + readLittle(bytes + 4, 4) * 16) {
+            view = std::string_view();
+            return -1;
+        }
+        return readLittle(bytes + 8, 4);
+    }
+
+    /**
+     * Build the position index from the postings, then clear them
+     * - sorted by hash, game, ply => lookups are a binary search over the blocks
+     * - header: u32 magic TPIX, u32 number of blocks, u32 number of postings, u32 0
+     * - blocks: u64 first hash, u32 offset in the index, u32 number of postings
+     * - INDEX_BLOCK postings per block, varints: hash delta, game (delta if same hash), ply
+     * - little endian, can be memory mapped as is, see attach
+     * @returns index
+     */
+    const std::string &build() {
+        std::sort(postings.begin(), postings.end());
+        int num_posting = postings.size(),
+            num_block = (num_posting + INDEX_BLOCK - 1) / INDEX_BLOCK;
+
+        buffer.clear();
+        writeLittle(buffer, INDEX_MAGIC, 4);
+        writeLittle(buffer, num_block, 4);
+        writeLittle(buffer, num_posting, 4);
+        writeLittle(buffer, 0, 4);
+        buffer.resize(INDEX_HEADER + num_block * 16);
+
+        std::string table;
+        for (auto block = 0; block < num_block; block ++) {
+            auto start = block * INDEX_BLOCK,
+                end = Min(start + INDEX_BLOCK, num_posting);
+            auto prev = &postings[start];
+            writeLittle(table, prev->hash, 8);
+            writeLittle(table, buffer.size(), 4);
+            writeLittle(table, end - start, 4);
+
+            for (auto i = start; i < end; i ++) {
+                auto &posting = postings[i];
+                auto delta = posting.hash - prev->hash;
+                writeVarint(buffer, delta);
+                writeVarint(buffer, (delta || i == start)? posting.game: posting.game - prev->game);
+                writeVarint(buffer, posting.ply);
+                prev = &posting;
+            }
+        }
+        buffer.replace(INDEX_HEADER, table.size(), table);
+
+        postings.clear();
+        postings.shrink_to_fit();
+        attach(buffer.data(), buffer.size());
+        return buffer;
+    }
+
+    /**
+     * Move the postings of another instance, ex: 1 instance per thread
+     * @param other
+     */
+    void merge(Index &other) {
+        postings.insert(postings.end(), other.postings.begin(), other.postings.end());
+        other.postings.clear();
+    }
+
+    /**
+     * Find the games that reached a position, see query
+     * @param fen_
+     * @returns number of matches
+     */
+    int position(std::string fen_) {
+        chess.load(fen_, true);
+        return query(chess.openingKey());
+    }
+
+    /**
+     * Find the games that reached a position
+     * @param hash openingKey of the position
+     * @returns number of matches, the game + ply pairs are in matches
+     */
+    int query(Hash hash) {
+        matches.clear();
+        if (view.size() < INDEX_HEADER)
+            return 0;
+
+        auto data = (const uint8_t *)view.data(),
+            end = data + view.size();
+        int num_block = readLittle(data + 4, 4);
+        auto table = data + INDEX_HEADER;
+
+        // 1) last block starting before the hash: the matches can start at its end
+        int left = 0,
+            right = num_block;
+        while (left < right) {
+            auto middle = (left + right) >> 1;
+            if (readLittle(table + middle * 16, 8) < hash)
+                left = middle + 1;
+            else
+                right = middle;
+        }
+
+        // 2) decode the blocks until the hash is passed
+        for (auto block = Max(left - 1, 0); block < num_block; block ++) {
+            auto entry = table + block * 16;
+            Hash value = readLittle(entry, 8);
+            if (value > hash)
+                break;
+            auto ptr = data + readLittle(entry + 8, 4);
+            int count = readLittle(entry + 12, 4),
+                game = 0;
+            for (auto i = 0; i < count && ptr < end; i ++) {
+                auto delta = readVarint(ptr, end);
+                value += delta;
+                game = (delta || !i)? readVarint(ptr, end): game + readVarint(ptr, end);
+                int ply_ = readVarint(ptr, end);
+                if (value > hash)
+                    return matches.size() / 2;
+                if (value == hash) {
+                    matches.push_back(game);
+                    matches.push_back(ply_);
+                }
+            }
+        }
+        return matches.size() / 2;
+    }
+
+    /**
+     * Matches of the last query
+     * @returns game + ply pairs
+     */
+    const std::vector<int32_t> &results() {
+        return matches;
+    }
+
+#ifdef __EMSCRIPTEN__
+    // EMSCRIPTEN INTERFACES
+    ////////////////////////
+
+    val em_build() {
+        auto &data = build();
+        return val(typed_memory_view(data.size(), (uint8_t *)data.data()));
+    }
+
+    int em_load(std::string data) {
+        buffer = data;
+        return attach(buffer.data(), buffer.size());
+    }
+
+    val em_results() {
+        return val(typed_memory_view(matches.size(), matches.data()));
+    }
+#endif
+};
+
+// random access to the plies of a game, for a long game viewer
+// - the moves are generated on the board of a Chess instance, its position is replaced
+class Seeker {
+private:
+    Chess       &chess;
+    int         base;                           // index of the last loaded checkpoint, see seek
+    std::vector<std::string> checkpoints;       // FEN every SEEK_INTERVAL moves, 0 = root
+    Piece       last_board[128];                // board after the last seek, to detect outside changes
+    int         last_ply;                       // ply after the last seek
+    std::vector<Move> moves;                    // moves of the game
+    int         played;                         // moves played on the board, -1 if unknown
+    int         steps;                          // moves made + undone by the last seek
+
+public:
+    Seeker(Chess &chess_): chess(chess_) {
+        played = -1;
+        steps = 0;
+    }
+
+    /**
+     * Append moves to the game
+     * @param multi SAN or UCI moves, move numbers + annotations are skipped: 1. e4 e5 2. Nf3, e2e4 e7e5 g1f3
+     * @returns number of moves in the game, -1 if reset was not called
+     */
+    int add(std::string multi) {
+        if (seek(moves.size()).empty())
+            return -1;
+
+        std::string san;
+        int prev = 0,
+            size = multi.size();
+        for (int i = 0; i <= size; i ++) {
+            if (i < size && multi[i] != ' ')
+                continue;
+            auto token = std::string_view(multi).substr(prev, i - prev);
+            prev = i + 1;
+            if (token.empty() || chess.pgnSan(token, san) >= 0 || san.empty())
+                continue;
+
+            auto obj = chess.moveAuto(san, false);
+            if (obj.from == obj.to || obj.m.empty())
+                break;
+            moves.push_back(chess.packObject(obj));
+            played ++;
+            if (played % SEEK_INTERVAL == 0)
+                checkpoints.emplace_back(chess.createFen());
+        }
+
+        memcpy(last_board, chess.board, sizeof(chess.board));
+        last_ply = chess.ply;
+        return moves.size();
+    }
+
+    /**
+     * Start a new game for seek
+     * @param fen_ root position, empty for the default
+     * @returns number of moves: 0, -1 if the FEN is invalid
+     */
+    int reset(std::string fen_) {
+        checkpoints.clear();
+        played = -1;
+        moves.clear();
+        steps = 0;
+
+        if (chess.load(fen_.size()? fen_: DEFAULT_POSITION, false).empty())
+            return -1;
+        base = 0;
+        checkpoints.emplace_back(chess.createFen());
+        played = 0;
+        memcpy(last_board, chess.board, sizeof(chess.board));
+        last_ply = chess.ply;
+        return 0;
+    }
+
+    /**
+     * Go to a ply of the game, see add
+     * - a full position is stored every SEEK_INTERVAL moves, the ply states are the undo records in between
+     * - the board is moved from the current index, or reloaded from the checkpoint before the target,
+     *   whichever takes fewer moves => at most SEEK_INTERVAL - 1 moves made or undone
+     * @param index number of moves played from the root, 0 for the root
+     * @returns FEN, empty if invalid
+     */
+    std::string seek(int index) {
+        steps = 0;
+        if (index < 0 || index > (int)moves.size() || checkpoints.empty())
+            return "";
+
+        // 1) cost of moving from the current position, if the board was not changed since
+        auto checkpoint = index % SEEK_INTERVAL,
+            direct = SEEK_INTERVAL;
+        if (played >= 0 && chess.ply == last_ply && !memcmp(chess.board, last_board, sizeof(chess.board))) {
+            if (index >= played)
+                direct = index - played;
+            else if (played - index <= chess.ply)
+                direct = played - index;
+        }
+
+        // 2) reload the checkpoint
+        if (checkpoint < direct) {
+            base = index - checkpoint;
+            played = base;
+            chess.load(checkpoints[base / SEEK_INTERVAL], false);
+        }
+
+        // 3) make/undo the remaining moves
+        for (; played < index; played ++, steps ++)
+            chess.makeMove(moves[played]);
+        for (; played > index; played --, steps ++)
+            chess.undoMove();
+
+        memcpy(last_board, chess.board, sizeof(chess.board));
+        last_ply = chess.ply;
+        return chess.createFen();
+    }
+
+#ifdef __EMSCRIPTEN__
+    // EMSCRIPTEN INTERFACES
+    ////////////////////////
+
+    int em_steps() {
+        return steps;
+    }
+#endif
+};
+
+// columnar position store, queried with predicates
+// - the moves are generated on the board of a Chess instance, its position is replaced
+class Store {
+private:
+    Chess       &chess;
+    std::vector<float> evals;                   // columnar position store, 1 row per position, see add
+    std::vector<int32_t> games;
+    std::vector<uint64_t> materials;            // material_key
+    std::vector<Bitboard> pieces[15];           // 1 bitboard per piece, a8 = bit 0
+    std::vector<int32_t> plies;
+    std::vector<int32_t> results;               // rows matching the last query
+
+    /**
+     * Parse 1 condition of a store query, see query
+     * @param token
+     * @param predicate output
+     * @returns false if the syntax is invalid
+     */
+    bool parsePredicate(std::string_view token, Predicate &predicate) {
+        predicate = {0, false, 0, 0, 0, 0};
+        if (token.size() && token[0] == '!') {
+            predicate.negate = true;
+            token.remove_prefix(1);
+        }
+        if (token.empty())
+            return false;
+
+        // 1) opposite colored bishops
+        if (token == "ocb") {
+            predicate.field = 6;
+            return true;
+        }
+
+        // 2) piece on squares: P@7 (rank), P@e (file), P@e4, Q@a1,h8
+        if (token.size() > 2 && token[1] == '@') {
+            auto it = PIECES.find(token[0]);
+            if (it == PIECES.end())
+                return false;
+            predicate.field = 1;
+            predicate.piece = it->second;
+            auto squares = token.substr(2);
+            size_t start = 0;
+            while (start <= squares.size()) {
+                auto end = squares.find(',', start);
+                if (end == std::string_view::npos)
+                    end = squares.size();
+                auto text = squares.substr(start, end - start);
+                start = end + 1;
+
+                if (text.size() == 1 && text[0] >= '1' && text[0] <= '8')
+                    predicate.mask |= 0xffull << (('8' - text[0]) << 3);
+                else if (text.size() == 1 && text[0] >= 'a' && text[0] <= 'h')
+                    predicate.mask |= 0x0101010101010101ull << (text[0] - 'a');
+                else if (text.size() == 2 && text[0] >= 'a' && text[0] <= 'h' && text[1] >= '1' && text[1] <= '8')
+                    predicate.mask |= 1ull << ((('8' - text[1]) << 3) + text[0] - 'a');
+                else
+                    return false;
+            }
+            return true;
+        }
+
+        // 3) material signature: KRPkr
+        if (token[0] == 'K' && token.find('k') != std::string_view::npos
+                && token.find_first_not_of("KQRBNPkqrbnp") == std::string_view::npos) {
+            predicate.field = 2;
+            for (auto letter : token)
+                if (letter != 'K' && letter != 'k')
+                    predicate.mask += MaterialUnit(pieceCode(letter));
+            return true;
+        }
+
+        // 4) key, operator, value: eval>2, ply>=40, game=5, R=1
+        auto pos = token.find_first_of("=!<>");
+        if (pos == std::string_view::npos || !pos || pos + 1 >= token.size())
+            return false;
+        auto key = token.substr(0, pos);
+        auto two = (token[pos + 1] == '=');
+        switch (token[pos]) {
+        case '=': predicate.op = 0; two = false; break;
+        case '!': predicate.op = 1; if (!two) return false; break;
+        case '<': predicate.op = two? 3: 2; break;
+        case '>': predicate.op = two? 5: 4; break;
+        }
+
+        std::string number(token.substr(pos + (two? 2: 1)));
+        char *end;
+        predicate.value = strtod(number.c_str(), &end);
+        if (number.empty() || *end)
+            return false;
+
+        if (key == "eval")
+            predicate.field = 3;
+        else if (key == "ply")
+            predicate.field = 4;
+        else if (key == "game")
+            predicate.field = 5;
+        else if (key.size() == 1 && PIECES.find(key[0]) != PIECES.end())
+            predicate.piece = pieceCode(key[0]);
+        else
+            return false;
+        return true;
+    }
+
+    /**
+     * Apply a predicate to a block of the position store
+     * @param predicate
+     * @param start first row
+     * @param count number of rows, up to STORE_BLOCK
+     * @param hits rows still matching, updated
+     */
+    void scan(const Predicate &predicate, int start, int count, uint8_t *hits) {
+        auto negate = predicate.negate;
+        auto mask = predicate.mask;
+
+        switch (predicate.field) {
+        case 0: {
+            uint8_t counts[STORE_BLOCK];
+            auto bits = &pieces[predicate.piece][start];
+            for (auto i = 0; i < count; i ++)
+                counts[i] = __builtin_popcountll(bits[i]);
+            scanValues(counts, count, predicate, hits);
+            break;
+        }
+        case 1: {
+            auto bits = &pieces[predicate.piece][start];
+            for (auto i = 0; i < count; i ++)
+                hits[i] &= ((bits[i] & mask) != 0) != negate;
+            break;
+        }
+        case 2: {
+            auto keys = &materials[start];
+            for (auto i = 0; i < count; i ++)
+                hits[i] &= (keys[i] == mask) != negate;
+            break;
+        }
+        case 3:
+            scanValues(&evals[start], count, predicate, hits);
+            break;
+        case 4:
+            scanValues(&plies[start], count, predicate, hits);
+            break;
+        case 5:
+            scanValues(&games[start], count, predicate, hits);
+            break;
+        case 6: {
+            auto whites = &pieces[COLORIZE(WHITE, BISHOP)][start],
+                blacks = &pieces[COLORIZE(BLACK, BISHOP)][start];
+            for (auto i = 0; i < count; i ++) {
+                auto white = whites[i],
+                    black = blacks[i];
+                auto ocb = !(white & (white - 1)) && !(black & (black - 1))
+                    && white && black && !(white & LIGHT_SQUARES) != !(black & LIGHT_SQUARES);
+                hits[i] &= ocb != negate;
             }
-            board[move_to] = 0;
-            board[move_from] = piece;
+            break;
+        }
+        }
+    }
 
-            auto piece_type = TYPE(piece);
-            if (piece_type == KING)
-                kings[us] = move_from;
+    /**
+     * Compare a column with a value, the op is resolved outside the loops so they can be vectorized
+     * @param values column
+     * @param count number of rows
+     * @param predicate
+     * @param hits rows still matching, updated
+     */
+    template <typename T>
+    void scanValues(const T *values, int count, const Predicate &predicate, uint8_t *hits) {
+        auto negate = predicate.negate;
+        T value = predicate.value;
+        switch (predicate.op) {
+        case 0: for (auto i = 0; i < count; i ++) hits[i] &= (values[i] == value) != negate; break;
+        case 1: for (auto i = 0; i < count; i ++) hits[i] &= (values[i] != value) != negate; break;
+        case 2: for (auto i = 0; i < count; i ++) hits[i] &= (values[i] < value) != negate; break;
+        case 3: for (auto i = 0; i < count; i ++) hits[i] &= (values[i] <= value) != negate; break;
+        case 4: for (auto i = 0; i < count; i ++) hits[i] &= (values[i] > value) != negate; break;
+        case 5: for (auto i = 0; i < count; i ++) hits[i] &= (values[i] >= value) != negate; break;
+        }
+    }
 
-            if (move_flag & BITS_EN_PASSANT) {
-                auto capture = COLORIZE(them, PAWN);
-                Square target = move_to + 16 - (us << 5);
-                board[target] = capture;
-                materials[them] += PIECE_SCORES[PAWN];
-            }
-            else if (move_capture) {
-                auto capture = COLORIZE(them, move_capture);
-                board[move_to] = capture;
-                materials[them] += PIECE_SCORES[move_capture];
+public:
+    Store(Chess &chess_): chess(chess_) {}
+
+    /**
+     * Add the positions of a PGN text to the columnar store, see query
+     * - 1 row per move: game, ply, eval (wv= of the comment, NAN if missing), material_key, 1 bitboard per piece
+     * @param pgn complete games
+     * @param game_id id of the first game
+     * @returns number of games
+     */
+    int add(std::string pgn, int game_id) {
+        chess.pgnReset(false);
+        int num_game = chess.pgnFeed(pgn, true);
+        for (auto i = 0; i < num_game; i ++, game_id ++) {
+            auto record = chess.pgnGame(i);
+            for (auto j = 0; j < record[3]; j ++) {
+                auto id = record[2] + j;
+                chess.replayMove(id);
+
+                Bitboard bits[15] = {0};
+                for (auto square = SQUARE_A8; square <= SQUARE_H1; square ++) {
+                    if (square & 0x88) {
+                        square += 7;
+                        continue;
+                    }
+                    auto piece = chess.board[square];
+                    if (piece)
+                        bits[piece] |= 1ull << Square64(square);
+                }
+                for (auto piece = 1; piece < 15; piece ++)
+                    if (PIECE_ORDERS[piece])
+                        pieces[piece].push_back(bits[piece]);
+
+                evals.push_back(chess.pgn_evals[id]);
+                games.push_back(game_id);
+                materials.push_back(chess.material_key);
+                plies.push_back(chess.fen_ply + chess.ply);
             }
+        }
+        return num_game;
+    }
 
-            // score
-            auto psquares = squares[piece_type];
-            positions[turn] += psquares[move_from] - psquares[move_to];
+    /**
+     * Find the positions matching all the conditions of a query, see parsePredicate
+     * - conditions separated by spaces, ! to negate: R=1 r=1 ocb, P@7 eval>2, KRPkr !ply<40
+     * - the store is scanned by blocks of STORE_BLOCK rows, 1 predicate at a time
+     * @param query
+     * @param num_thread 0 for all the cores, always 1 in wasm
+     * @returns number of matches, the rows are in results, -1 if the query is invalid
+     */
+    int query(std::string query, int num_thread) {
+        results.clear();
+
+        // 1) parse
+        std::vector<Predicate> predicates;
+        std::string_view view(query);
+        size_t start = 0;
+        while (start < view.size()) {
+            auto end = view.find(' ', start);
+            if (end == std::string_view::npos)
+                end = view.size();
+            auto token = view.substr(start, end - start);
+            start = end + 1;
+            if (token.empty())
+                continue;
+            Predicate predicate;
+            if (!parsePredicate(token, predicate))
+                return -1;
+            predicates.push_back(predicate);
         }
 
-        return true;
+        // 2) workers
+        int num_row = games.size(),
+            num_block = (num_row + STORE_BLOCK - 1) / STORE_BLOCK;
+#ifdef __EMSCRIPTEN__
+        num_thread = 1;
+#else
+        if (num_thread <= 0)
+            num_thread = std::thread::hardware_concurrency();
+#endif
+        num_thread = Max(1, Min(num_thread, num_block));
+
+        // 3) scan, the matches of each block are concatenated in order
+        std::vector<std::vector<int32_t>> matches(num_block);
+        std::atomic<int> next(0);
+        auto run = [&]() {
+            uint8_t hits[STORE_BLOCK];
+            while (true) {
+                int block = next.fetch_add(1);
+                if (block >= num_block)
+                    break;
+                auto first = block * STORE_BLOCK;
+                auto count = Min(STORE_BLOCK, num_row - first);
+                memset(hits, 1, count);
+                for (auto &predicate : predicates)
+                    scan(predicate, first, count, hits);
+                for (auto i = 0; i < count; i ++)
+                    if (hits[i])
+                        matches[block].push_back(first + i);
+            }
+        };
+
+#ifdef __EMSCRIPTEN__
+        run();
+#else
+        std::vector<std::thread> threads;
+        for (auto i = 1; i < num_thread; i ++)
+            threads.emplace_back(run);
+        run();
+        for (auto &thread : threads)
+            thread.join();
+#endif
+
+        for (auto &rows : matches)
+            results.insert(results.end(), rows.begin(), rows.end());
+        return results.size();
     }
 
     /**
-     * Unpack a move to an object
-     * - 0-9 : order
-     * - 10-12 : capture
-     * - 13-14 : flag
-     * - 15-21 : from
-     * - 22-24 : promote
-     * - 25-31 : to
+     * Clear the position store
      */
-    MoveText unpackMove(Move move) {
-        return {
-            MoveCapture(move),
-            MoveFlag(move),
-            MoveFrom(move),
-            MovePromote(move),
-            static_cast<int>(move & 1023),
-            MoveTo(move),
-        };
+    void reset() {
+        evals.clear();
+        games.clear();
+        materials.clear();
+        for (auto &bits : pieces)
+            bits.clear();
+        plies.clear();
+        results.clear();
     }
 
+#ifdef __EMSCRIPTEN__
     // EMSCRIPTEN INTERFACES
     ////////////////////////
 
-    val em_attacks() {
-        return val(typed_memory_view(16, attacks));
+    val em_column(std::string name) {
+        if (name == "eval")
+            return val(typed_memory_view(evals.size(), evals.data()));
+        if (name == "game")
+            return val(typed_memory_view(games.size(), games.data()));
+        if (name == "ply")
+            return val(typed_memory_view(plies.size(), plies.data()));
+        return val(typed_memory_view(results.size(), results.data()));
     }
+#endif
+};
 
-    int em_avgDepth() {
-        return max_depth;
-    }
+// variation tree: mainline + PVs + kibitzer lines, the identical moves are shared
+// - the moves are generated on the board of a Chess instance, its position is replaced
+class Tree {
+private:
+    Chess       &chess;
+    int         common;                         // common ancestor of the last delta
+    std::vector<TreeNode> nodes;                // arena, 0 = root
+    std::string root_fen;                       // root position of the tree
+    std::string text;                           // SAN + UCI arena of nodes
 
-    val em_board() {
-        return val(typed_memory_view(128, board));
+    /**
+     * Find the child that plays a move
+     * @param id parent node
+     * @param token SAN (+# optional) or UCI, empty to only compare the moves
+     * @param move compared if not 0
+     * @returns child node, -1 if not found
+     */
+    int findChild(int id, std::string_view token, Move move) {
+        if (token.size() && (token.back() == '+' || token.back() == '#'))
+            token.remove_suffix(1);
+
+        for (auto child = nodes[id].child; child >= 0; child = nodes[child].sibling) {
+            auto &node = nodes[child];
+            if (move) {
+                if ((node.move >> 10) == (move >> 10))
+                    return child;
+                continue;
+            }
+            auto san = std::string_view(text).substr(node.text, node.san_size),
+                uci = std::string_view(text).substr(node.text + node.san_size, node.uci_size);
+            if (san.size() && (san.back() == '+' || san.back() == '#'))
+                san.remove_suffix(1);
+            if (token == san || token == uci)
+                return child;
+        }
+        return -1;
     }
 
-    int32_t em_boardHash() {
-        return (int32_t)board_hash;
-    }
+    /**
+     * Set the board to the position of a tree node, by replaying the moves from the root
+     * @param id node
+     */
+    void play(int id) {
+        std::vector<Move> moves;
+        for (; id > 0; id = nodes[id].parent)
+            moves.push_back(nodes[id].move);
 
-    val em_castling() {
-        return val(typed_memory_view(4, castling));
+        chess.load(root_fen, true);
+        for (auto it = moves.rbegin(); it != moves.rend(); it ++)
+            chess.makeMove(*it);
     }
 
-    bool em_checked(int color) {
-        return kingAttacked(color);
+public:
+    Tree(Chess &chess_): chess(chess_) {
+        common = -1;
     }
 
-    val em_defenses() {
-        return val(typed_memory_view(16, defenses));
-    }
+    /**
+     * Add a line to the variation tree: mainline, engine PV, kibitzer line
+     * - the moves already in the tree are reused without parsing => identical continuations are shared
+     * - the board is only replayed when a new move must be parsed
+     * @param id node where the line starts, 0 for the root
+     * @param multi SAN or UCI moves, move numbers + annotations are skipped: 1. e4 e5 2. Nf3, e2e4 e7e5 g1f3
+     * @returns last node of the line, -1 if the start node is invalid, ex: reset was not called
+     */
+    int add(int id, std::string multi) {
+        if (id < 0 || id >= (int)nodes.size())
+            return -1;
 
-    std::string em_fen() {
-        return fen;
-    }
+        auto ready = false;
+        std::string san;
+        int prev = 0,
+            size = multi.size();
+        for (int i = 0; i <= size; i ++) {
+            if (i < size && multi[i] != ' ')
+                continue;
+            auto token = std::string_view(multi).substr(prev, i - prev);
+            prev = i + 1;
+            if (token.empty() || chess.pgnSan(token, san) >= 0 || san.empty())
+                continue;
 
-    bool em_frc() {
-        return frc;
+            // 1) move already in the tree
+            auto child = findChild(id, san, 0);
+            if (child >= 0) {
+                id = child;
+                ready = false;
+                continue;
+            }
+
+            // 2) parse the move
+            if (!ready) {
+                play(id);
+                ready = true;
+            }
+            auto obj = chess.moveAuto(san, true);
+            if (obj.from == obj.to || obj.m.empty())
+                break;
+
+            // e1g1 vs e1h1, Nf3 vs Ngf3 ...
+            auto move = chess.packObject(obj);
+            child = findChild(id, "", move);
+            if (child >= 0) {
+                id = child;
+                continue;
+            }
+
+            // 3) new node, appended to the children
+            auto uci = chess.ucifyMove(move);
+            TreeNode node = {chess.board_hash, move, -1, id, chess.fen_ply + chess.ply, -1, (int32_t)text.size(),
+                (uint8_t)obj.m.size(), (uint8_t)uci.size()};
+            text += obj.m;
+            text += uci;
+
+            int new_id = nodes.size();
+            auto last = nodes[id].child;
+            if (last < 0)
+                nodes[id].child = new_id;
+            else {
+                while (nodes[last].sibling >= 0)
+                    last = nodes[last].sibling;
+                nodes[last].sibling = new_id;
+            }
+            nodes.push_back(node);
+            id = new_id;
+        }
+        return id;
     }
 
-    std::vector<int> em_hashStats() {
-        return {tt_adds, tt_hits};
+    /**
+     * Get the children of a node, in the order they were added
+     * @param id
+     * @returns nodes
+     */
+    std::vector<int> children(int id) {
+        std::vector<int> children;
+        if (id >= 0 && id < (int)nodes.size())
+            for (auto child = nodes[id].child; child >= 0; child = nodes[child].sibling)
+                children.push_back(child);
+        return children;
     }
 
-    int em_material(int color) {
-        return materials[color];
+    /**
+     * Moves to go from a path to another one, ex: the board shows a PV that was updated
+     * - the common ancestor is stored in common: the moves after it must be removed
+     * @param old_id end of the displayed path
+     * @param new_id end of the new path
+     * @returns moves after the common ancestor, to new_id
+     */
+    std::vector<MoveText> delta(int old_id, int new_id) {
+        std::vector<MoveText> objs;
+        int num_node = nodes.size();
+        if (old_id < 0 || old_id >= num_node || new_id < 0 || new_id >= num_node) {
+            common = -1;
+            return objs;
+        }
+
+        // 1) common ancestor: walk up the deepest node first
+        auto a = old_id,
+            b = new_id;
+        while (a != b) {
+            if (nodes[a].ply >= nodes[b].ply && a > 0)
+                a = nodes[a].parent;
+            else
+                b = nodes[b].parent;
+        }
+        common = a;
+
+        // 2) path from the ancestor
+        for (auto id = new_id; id != common; id = nodes[id].parent)
+            objs.push_back(node(id));
+        std::reverse(objs.begin(), objs.end());
+        return objs;
     }
 
-    val em_mobilities() {
-        return val(typed_memory_view(16, mobilities));
+    /**
+     * Get the FEN of a node
+     * @param id
+     * @returns FEN, empty if invalid
+     */
+    std::string fen(int id) {
+        if (id < 0 || id >= (int)nodes.size())
+            return "";
+        play(id);
+        return chess.createFen();
     }
 
-    int em_nodes() {
-        return nodes;
+    /**
+     * Get the move of a node
+     * @param id
+     * @returns move with the SAN + ply, from == to for the root or if invalid
+     */
+    MoveText node(int id) {
+        if (id <= 0 || id >= (int)nodes.size())
+            return NULL_OBJ;
+        auto &node = nodes[id];
+        auto obj = chess.unpackMove(node.move);
+        obj.m = text.substr(node.text, node.san_size);
+        obj.ply = node.ply;
+        obj.score = 0;
+        return obj;
     }
 
-    Piece em_piece(std::string text) {
-        if (text.size() != 1)
-            return 0;
-        auto it = PIECES.find(text.at(0));
-        return (it != PIECES.end())? it->second: 0;
+    /**
+     * Get the parent of a node
+     * @param id
+     * @returns parent, -1 for the root or if invalid
+     */
+    int parent(int id) {
+        return (id > 0 && id < (int)nodes.size())? nodes[id].parent: -1;
     }
 
-    int em_selDepth() {
-        return Max(avg_depth, sel_depth);
+    /**
+     * Get the path from the root to a node
+     * @param id
+     * @returns nodes, the root excluded
+     */
+    std::vector<int> path(int id) {
+        std::vector<int> path;
+        if (id >= 0 && id < (int)nodes.size())
+            for (; id > 0; id = nodes[id].parent)
+                path.push_back(id);
+        std::reverse(path.begin(), path.end());
+        return path;
     }
 
-    std::string em_trace() {
-        return trace;
+    /**
+     * Start a new variation tree
+     * @param fen_ root position, empty for the default
+     * @returns root node: 0
+     */
+    int reset(std::string fen_) {
+        common = -1;
+        root_fen = fen_.size()? fen_: DEFAULT_POSITION;
+        nodes.clear();
+        text.clear();
+
+        chess.load(root_fen, true);
+        nodes.push_back({chess.board_hash, 0, -1, -1, chess.fen_ply + chess.ply, -1, 0, 0, 0});
+        return 0;
     }
 
-    int em_turn() {
-        return turn;
+#ifdef __EMSCRIPTEN__
+    // EMSCRIPTEN INTERFACES
+    ////////////////////////
+
+    int em_common() {
+        return common;
     }
 
-    std::string em_version() {
-        return "20201102";
+    int em_size() {
+        return nodes.size();
     }
+#endif
 };
 
 // BINDING CODE
 ///////////////
 
+#ifdef __EMSCRIPTEN__
 EMSCRIPTEN_BINDINGS(chess) {
     // MOVE BINDINGS
     value_object<MoveText>("MoveText")
@@ -2655,26 +7455,40 @@ EMSCRIPTEN_BINDINGS(chess) {
     class_<Chess>("Chess")
         .constructor()
         //
+        .function("agreeAdd", &Chess::agreeAdd)
+        .function("agreeLengths", &Chess::em_agreeLengths)
+        .function("agreeReset", &Chess::agreeReset)
         .function("anToSquare", &Chess::anToSquare)
         .function("attacked", &Chess::attacked)
+        .function("attackMap", &Chess::em_attackMap)
         .function("attacks", &Chess::em_attacks)
         .function("avgDepth", &Chess::em_avgDepth)
+        .function("bitbase", &Chess::generateBitbase)
         .function("board", &Chess::em_board)
         .function("boardHash", &Chess::em_boardHash)
         .function("castling", &Chess::em_castling)
         .function("checked", &Chess::em_checked)
         .function("cleanSan", &Chess::cleanSan)
         .function("clear", &Chess::clear)
+        .function("comments", &Chess::em_comments)
         .function("configure", &Chess::configure)
         .function("currentFen", &Chess::em_fen)
+        .function("decodeGame", &Chess::decodeGame)
         .function("decorateSan", &Chess::decorateSan)
         .function("defenses", &Chess::em_defenses)
-        .function("evaluate", &Chess::evaluate)
+        .function("encodeGame", &Chess::em_encodeGame)
+        .function("evaluate", &Chess::em_evaluate)
+        .function("evaluateBatch", &Chess::em_evaluateBatch)
+        .function("evaluateTrace", &Chess::evaluateTrace)
         .function("fen", &Chess::createFen)
         .function("fen960", &Chess::createFen960)
         .function("frc", &Chess::em_frc)
+        .function("gameColumns", &Chess::em_gameColumns)
         .function("hashBoard", &Chess::hashBoard)
         .function("hashStats", &Chess::em_hashStats)
+        .function("infos", &Chess::em_infos)
+        .function("isLegal", &Chess::isLegal)
+        .function("leastAttacker", &Chess::leastAttacker)
         .function("load", &Chess::load)
         .function("makeMove", &Chess::makeMove)
         .function("material", &Chess::em_material)
@@ -2685,31 +7499,458 @@ EMSCRIPTEN_BINDINGS(chess) {
         .function("moveToSan", &Chess::moveToSan)
         .function("moveUci", &Chess::moveUci)
         .function("multiSan", &Chess::multiSan)
+        .function("multiSanPacked", &Chess::multiSanPacked)
         .function("multiUci", &Chess::multiUci)
+        .function("multiUciBatch", &Chess::multiUciBatch)
+        .function("multiUciPacked", &Chess::multiUciPacked)
         .function("nodes", &Chess::em_nodes)
         .function("order", &Chess::orderMoves)
         .function("packObject", &Chess::packObject)
+        .function("packPosition", &Chess::em_packPosition)
         .function("params", &Chess::params)
+        .function("parseComments", &Chess::parseComments)
+        .function("parseInfos", &Chess::parseInfos)
         .function("perft", &Chess::perft)
+        .function("pgnFeed", &Chess::pgnFeed)
+        .function("pgnGames", &Chess::em_pgnGames)
+        .function("pgnReset", &Chess::pgnReset)
         .function("piece", &Chess::em_piece)
+        .function("plyHashes", &Chess::em_plyHashes)
         .function("prepare", &Chess::prepareSearch)
         .function("print", &Chess::print)
+        .function("probe", &Chess::em_probe)
         .function("put", &Chess::put)
+        .function("replayMoves", &Chess::em_replayMoves)
+        .function("replayText", &Chess::em_replayText)
         .function("reset", &Chess::reset)
         .function("sanToObject", &Chess::sanToObject)
         .function("search", &Chess::search)
         .function("selDepth", &Chess::em_selDepth)
+        .function("signature", &Chess::em_signature)
         .function("squareToAn", &Chess::squareToAn)
         .function("trace", &Chess::em_trace)
+        .function("trackAttacks", &Chess::trackAttacks)
+        .function("trackPrefix", &Chess::em_trackPrefix)
+        .function("trackPv", &Chess::trackPv)
         .function("turn", &Chess::em_turn)
         .function("ucifyMove", &Chess::ucifyMove)
         .function("ucifyObject", &Chess::ucifyObject)
         .function("undo", &Chess::undoMove)
         .function("unpackMove", &Chess::unpackMove)
+        .function("unpackPosition", &Chess::em_unpackPosition)
         .function("version", &Chess::em_version)
         ;
 
+    // ARCHIVE BINDINGS
+    class_<Book>("Book")
+        .constructor<Chess &>()
+        //
+        .function("add", &Book::add)
+        .function("build", &Book::em_build)
+        .function("key", &Book::em_key)
+        .function("load", &Book::em_load)
+        .function("moves", &Book::moves)
+        .function("pick", &Book::pick)
+        ;
+
+    class_<Eco>("Eco")
+        .constructor<Chess &>()
+        //
+        .function("classify", &Eco::classify)
+        .function("games", &Eco::games)
+        .function("load", &Eco::load)
+        .function("name", &Eco::name)
+        .function("reset", &Eco::reset)
+        ;
+
+    class_<Explorer>("Explorer")
+        .constructor<Chess &>()
+        //
+        .function("add", &Explorer::add)
+        .function("build", &Explorer::em_build)
+        .function("load", &Explorer::em_load)
+        .function("query", &Explorer::query)
+        .function("reset", &Explorer::reset)
+        .function("results", &Explorer::em_results)
+        ;
+
+    class_<Index>("Index")
+        .constructor<Chess &>()
+        //
+        .function("add", &Index::add)
+        .function("build", &Index::em_build)
+        .function("load", &Index::em_load)
+        .function("query", &Index::position)
+        .function("results", &Index::em_results)
+        ;
+
+    class_<Seeker>("Seeker")
+        .constructor<Chess &>()
+        //
+        .function("add", &Seeker::add)
+        .function("reset", &Seeker::reset)
+        .function("seek", &Seeker::seek)
+        .function("steps", &Seeker::em_steps)
+        ;
+
+    class_<Store>("Store")
+        .constructor<Chess &>()
+        //
+        .function("add", &Store::add)
+        .function("column", &Store::em_column)
+        .function("query", &Store::query)
+        .function("reset", &Store::reset)
+        ;
+
+    class_<Tree>("Tree")
+        .constructor<Chess &>()
+        //
+        .function("add", &Tree::add)
+        .function("children", &Tree::children)
+        .function("common", &Tree::em_common)
+        .function("delta", &Tree::delta)
+        .function("fen", &Tree::fen)
+        .function("node", &Tree::node)
+        .function("parent", &Tree::parent)
+        .function("path", &Tree::path)
+        .function("reset", &Tree::reset)
+        .function("size", &Tree::em_size)
+        ;
+
     register_vector<int>("vector<int>");
     register_vector<Move>("vector<Move>");
     register_vector<MoveText>("vector<MoveText>");
 }
+#endif
+
+#ifndef __EMSCRIPTEN__
+// NATIVE
+/////////
+
+// archive tools of a thread: 1 board + its book + index
+// - on the heap: Chess holds the hash table, too large for the 1 MB stack on Windows
+class Archive {
+public:
+    Chess   chess;
+    Book    book;
+    Index   index;
+
+    Archive(): book(chess), index(chess) {}
+
+    /**
+     * Replay the games of a PGN text once, adding their positions to the lines, book and index
+     * - the games with an invalid move are skipped
+     * @param pgn complete games
+     * @param game_id
+     * @param max_ply moves per game added to the book, 0 for no book
+     * @param has_index
+     * @param lines output, 1 line per move, see Chess::pgnPosition, nullptr for no lines
+     * @returns false if a game has an invalid move
+     */
+    bool replay(std::string pgn, int game_id, int max_ply, bool has_index, std::string *lines) {
+        auto valid = true;
+        chess.pgnReset(false);
+        int num_game = chess.pgnFeed(pgn, true);
+        for (auto i = 0; i < num_game; i ++) {
+            auto record = chess.pgnGame(i);
+            if (!record[5]) {
+                valid = false;
+                continue;
+            }
+            auto result = record[4];
+            for (auto j = 0; j < record[3]; j ++) {
+                if (result && j < max_ply)
+                    book.addMove(record[2] + j, result);
+                else
+                    chess.replayMove(record[2] + j);
+                if (has_index)
+                    index.addPosition(game_id);
+                if (lines)
+                    chess.pgnPosition(*lines, game_id, result);
+            }
+        }
+        return valid;
+    }
+};
+
+/**
+ * Hand out the task ids in order, then write their outputs in the same order
+ * - at most `window` tasks are started but not written => the memory does not grow with the number of tasks
+ * - the output of a task is written by the thread that completes the oldest pending task
+ */
+class ReorderQueue {
+public:
+    ReorderQueue(int num_task_, int window, std::ostream *out_):
+        done(window), num_task(num_task_), out(out_), texts(window) {}
+
+    /**
+     * Get the next task, waits while the window is full
+     * @param task output
+     * @returns false when all the tasks were handed out
+     */
+    bool pop(int &task) {
+        std::unique_lock<std::mutex> lock(mutex);
+        int window = texts.size();
+        condition.wait(lock, [&] { return next >= num_task || next < written + window; });
+        if (next >= num_task)
+            return false;
+        task = next ++;
+        return true;
+    }
+
+    /**
+     * Complete a task, then write all the consecutive completed tasks
+     * @param task
+     * @param text output of the task
+     */
+    void push(int task, std::string &&text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int window = texts.size();
+        texts[task % window] = std::move(text);
+        done[task % window] = true;
+
+        auto start = written;
+        for (; written < num_task && done[written % window]; written ++) {
+            auto slot = written % window;
+            if (out)
+                *out << texts[slot];
+            std::string().swap(texts[slot]);
+            done[slot] = false;
+        }
+        if (written > start)
+            condition.notify_all();
+    }
+
+private:
+    std::condition_variable condition;
+    std::vector<bool> done;                     // per slot: task % window
+    std::mutex mutex;
+    int next = 0;                               // next task to hand out
+    int num_task;
+    std::ostream *out;                          // nullptr => no output
+    std::vector<std::string> texts;             // per slot: task % window
+    int written = 0;                            // oldest task not written yet
+};
+
+/**
+ * Memory map a file, read only, it stays mapped until the process exits
+ * @param filename
+ * @param size output
+ * @returns data, nullptr on error
+ */
+const char *mapFile(const std::string &filename, size_t &size) {
+    size = 0;
+#ifdef _WIN32
+    auto file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER large;
+    GetFileSizeEx(file, &large);
+    auto mapping = large.QuadPart? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr): nullptr;
+    CloseHandle(file);
+    if (!mapping)
+        return nullptr;
+    auto data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    size = data? large.QuadPart: 0;
+    return (const char *)data;
+#else
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (!fstat(fd, &info) && info.st_size > 0)
+        data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return nullptr;
+    size = info.st_size;
+    return (const char *)data;
+#endif
+}
+
+/**
+ * Split a PGN file into games: a new game starts with a header after some move text
+ * - the games are views of the text, nothing is copied
+ */
+void splitGames(std::string_view text, std::vector<std::string_view> &games) {
+    size_t game = 0,
+        start = 0;
+    auto has_moves = false;
+    while (start < text.size()) {
+        auto end = text.find('\n', start);
+        if (end == std::string_view::npos)
+            end = text.size();
+
+        auto first = text.find_first_not_of(" \t\r", start);
+        if (first < end) {
+            if (text[first] == '[') {
+                if (has_moves) {
+                    games.push_back(text.substr(game, start - game));
+                    game = start;
+                    has_moves = false;
+                }
+            }
+            else
+                has_moves = true;
+        }
+        start = end + 1;
+    }
+    if (game < text.size())
+        games.push_back(text.substr(game));
+}
+
+/**
+ * Replay and validate PGN archives on all the cores
+ * - chess [-b book] [-i index] [-o output] [-p plies] [-t threads] file1.pgn file2.pgn ...
+ * - chess [-b book] [-i index] -q fen
+ * - output: 1 line per position: hash, FEN, ply, game id, result, only to the console if there's no book/index
+ * - book: polyglot book of the first plies (default 30), see Book::build
+ * - index: position index, see Index::build
+ * - query: book moves: SAN, weight + index matches: game id, ply
+ * - the games are replayed once each, in parallel, and their lines are written in the game order
+ * - the games with an invalid move are skipped and reported on stderr
+ */
+int main(int argc, char **argv) {
+    int num_thread = std::thread::hardware_concurrency(),
+        plies = 30;
+    std::string book,
+        index,
+        output,
+        query;
+    std::vector<std::string> filenames;
+    for (auto i = 1; i < argc; i ++) {
+        std::string arg = argv[i];
+        if (arg == "-b" && i + 1 < argc)
+            book = argv[++ i];
+        else if (arg == "-i" && i + 1 < argc)
+            index = argv[++ i];
+        else if (arg == "-o" && i + 1 < argc)
+            output = argv[++ i];
+        else if (arg == "-p" && i + 1 < argc)
+            plies = atoi(argv[++ i]);
+        else if (arg == "-q" && i + 1 < argc)
+            query = argv[++ i];
+        else if (arg == "-t" && i + 1 < argc)
+            num_thread = atoi(argv[++ i]);
+        else
+            filenames.push_back(arg);
+    }
+
+    // 0) query the book + index
+    if (query.size() && (book.size() || index.size())) {
+        auto archive = new Archive();
+        auto code = 0;
+        size_t size;
+        if (book.size()) {
+            auto data = mapFile(book, size);
+            if (!data || archive->book.attach(data, size) < 0) {
+                std::cerr << "invalid book " << book << "\n";
+                code = 1;
+            }
+            else
+                for (auto &obj : archive->book.moves(query))
+                    std::cout << obj.m << '\t' << obj.score << '\n';
+        }
+        if (!code && index.size()) {
+            auto data = mapFile(index, size);
+            if (!data || archive->index.attach(data, size) < 0) {
+                std::cerr << "invalid index " << index << "\n";
+                code = 1;
+            }
+            else {
+                auto count = archive->index.position(query);
+                auto &results = archive->index.results();
+                for (auto i = 0; i < count; i ++)
+                    std::cout << results[i * 2] << '\t' << results[i * 2 + 1] << '\n';
+            }
+        }
+        DELETE(archive);
+        return code;
+    }
+    if (filenames.empty()) {
+        std::cerr << "usage: chess [-b book] [-i index] [-o output] [-p plies] [-t threads] file1.pgn file2.pgn ...\n"
+            "       chess [-b book] [-i index] -q fen\n";
+        return 1;
+    }
+
+    // 1) map + split the games, the files are not loaded in memory
+    std::vector<std::string_view> games;
+    for (auto &filename : filenames) {
+        size_t size;
+        auto data = mapFile(filename, size);
+        if (!data) {
+            std::cerr << "cannot read " << filename << "\n";
+            return 1;
+        }
+        splitGames(std::string_view(data, size), games);
+    }
+
+    // 2) replay on all the cores: each game is replayed once for the lines + book + index
+    int num_game = games.size();
+    num_thread = Max(1, Min(num_thread, num_game));
+    std::vector<int> invalids;
+    std::mutex invalid_mutex;
+
+    auto has_lines = (output.size() || (book.empty() && index.empty()));
+    std::ofstream file;
+    if (output.size())
+        file.open(output, std::ios::binary);
+    // 3) output in the game order, as soon as possible
+    ReorderQueue queue(num_game, num_thread * 64, has_lines? (output.size()? &file: &std::cout): nullptr);
+
+    // the instances are created here: the constructor initialises shared tables
+    std::vector<Archive *> workers(num_thread);
+    for (auto &worker : workers)
+        worker = new Archive();
+    auto run = [&](int worker) {
+        auto &archive = *workers[worker];
+        std::vector<int> errors;
+        int id;
+        while (queue.pop(id)) {
+            std::string lines;
+            if (!archive.replay(std::string(games[id]), id, book.size()? plies: 0, index.size(), has_lines? &lines: nullptr))
+                errors.push_back(id);
+            queue.push(id, std::move(lines));
+        }
+
+        std::lock_guard<std::mutex> lock(invalid_mutex);
+        invalids.insert(invalids.end(), errors.begin(), errors.end());
+    };
+
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < num_thread; i ++)
+        threads.emplace_back(run, i);
+    for (auto &thread : threads)
+        thread.join();
+    if (output.size())
+        file.close();
+
+    // 4) merge the entries of all the threads into the book + index
+    if (book.size()) {
+        auto &book_ = workers[0]->book;
+        for (auto i = 1; i < num_thread; i ++)
+            book_.merge(workers[i]->book);
+        auto &data = book_.build();
+        std::ofstream file(book, std::ios::binary);
+        file.write(data.data(), data.size());
+    }
+    if (index.size()) {
+        auto &index_ = workers[0]->index;
+        for (auto i = 1; i < num_thread; i ++)
+            index_.merge(workers[i]->index);
+        auto &data = index_.build();
+        std::ofstream file(index, std::ios::binary);
+        file.write(data.data(), data.size());
+    }
+    for (auto worker : workers)
+        delete worker;
+
+    std::sort(invalids.begin(), invalids.end());
+    for (auto id : invalids)
+        std::cerr << "invalid move in game " << id << "\n";
+    std::cerr << num_game << " games, " << invalids.size() << " invalid\n";
+    return invalids.size()? 2: 0;
+}
+#endif
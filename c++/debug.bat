@@ -1,2 +1,2 @@
-emcc --bind -o ../js/chess-wasm.js chess.cpp -s WASM=1 -Wall -s MODULARIZE=1
+emcc --bind -o ../js/chess-wasm.js chess.cpp -std=c++17 -s WASM=1 -Wall -s MODULARIZE=1 -s ALLOW_MEMORY_GROWTH=1
 rem -g4 --source-map-base ./map
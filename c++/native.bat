@@ -0,0 +1 @@
+g++ -o chess chess.cpp -std=c++17 -O3 -Wall -pthread
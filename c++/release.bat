@@ -1 +1 @@
-emcc --bind -o ../js/chess-wasm.js chess.cpp -s WASM=1 -Wall -s MODULARIZE=1 -O3 --closure 1
+emcc --bind -o ../js/chess-wasm.js chess.cpp -std=c++17 -s WASM=1 -Wall -s MODULARIZE=1 -s ALLOW_MEMORY_GROWTH=1 -O3 --closure 1
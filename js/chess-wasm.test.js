@@ -12,8 +12,15 @@ let Module = require('./chess-wasm.js'),
     {ArrayJS, Assign, IsArray, IsString, Keys, LS, Undefined} = require('./common'),
     {get_move_ply} = require('./global');
 
-let chess,
-    START_FEN = 'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1';
+let book,
+    chess,
+    eco,
+    explorer,
+    index,
+    seeker,
+    START_FEN = 'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1',
+    store,
+    tree;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -21,11 +28,61 @@ describe('chess.wasm', () => {
 beforeAll(async () => {
     let instance = await Module();
     chess = new instance.Chess();
+    book = new instance.Book(chess);
+    eco = new instance.Eco(chess);
+    explorer = new instance.Explorer(chess);
+    index = new instance.Index(chess);
+    seeker = new instance.Seeker(chess);
+    store = new instance.Store(chess);
+    tree = new instance.Tree(chess);
 });
 beforeEach(() => {
     chess.reset();
 });
 
+// agreeLengths
+[
+    [0, false, [[0, 0, START_FEN, 'e2e4 e7e5 g1f3'], [1, 0, START_FEN, 'e2e4 e7e5 b1c3 b8c6']], [2]],
+    [0, false, [[0, 0, START_FEN, 'g1f3 d7d5 d2d4 g8f6'], [1, 0, START_FEN, 'd2d4 d7d5 g1f3 c7c5']], [0]],
+    [0, true, [[0, 0, START_FEN, 'g1f3 d7d5 d2d4 g8f6'], [1, 0, START_FEN, 'd2d4 d7d5 g1f3 c7c5']], [3]],
+    [0, false, [[0, 0, START_FEN, 'g1f3 g8f6 b1c3 b8c6 e2e4'], [1, 0, START_FEN, 'b1c3 b8c6 g1f3 g8f6 d2d4']], [0]],
+    [0, true, [[0, 0, START_FEN, 'g1f3 g8f6 b1c3 b8c6 e2e4'], [1, 0, START_FEN, 'b1c3 b8c6 g1f3 g8f6 d2d4']], [4]],
+    [0, true, [[0, 0, START_FEN, 'g1f3 g8f6 d2d4 d7d5 c2c4'], [1, 0, START_FEN, 'd2d4 d7d5 g1f3 g8f6 c1f4']], [4]],
+    [0, true, [[0, 0, START_FEN, 'e2e4 c7c5 g1f3 d7d6'], [1, 0, START_FEN, 'g1f3 d7d6 e2e4 c7c5']], [4]],
+    [0, true, [[0, 1, START_FEN, 'g1f3'], [1, 0, START_FEN, 'g1f3']], [-1, -1]],
+    [
+        -1, false,
+        [
+            [0, 0, START_FEN, 'e2e4 e7e5 g1f3 b8c6'],
+            [0, 1, 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1', 'e7e5 g1f3 g8f6'],
+            [0, 2, 'rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2', 'g1f3 g8f6 d2d4'],
+        ],
+        [-1, 2, 2],
+    ],
+].forEach(([offset, by_hash, pvs, answer], id) => {
+    test(`agreeLengths:${id}`, () => {
+        chess.agreeReset(offset, by_hash);
+        for (let [side, ply, fen, multi] of pvs)
+            chess.agreeAdd(side, ply, fen, multi);
+        expect(Array.from(chess.agreeLengths())).toEqual(answer);
+    });
+});
+
+// agreeLengths incremental
+test('agreeLengths:incremental', () => {
+    chess.agreeReset(0, false);
+    chess.agreeAdd(0, 0, START_FEN, 'e2e4 e7e5');
+    chess.agreeAdd(1, 0, START_FEN, 'e2e4 c7c5');
+    expect(Array.from(chess.agreeLengths())).toEqual([1]);
+
+    chess.agreeAdd(0, 1, 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1', 'c7c5 g1f3');
+    expect(Array.from(chess.agreeLengths())).toEqual([1, -1]);
+
+    chess.agreeAdd(1, 1, 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1', 'c7c5 g1f3 d7d6');
+    chess.agreeAdd(1, 0, START_FEN, 'e2e4 e7e5 g1f3');
+    expect(Array.from(chess.agreeLengths())).toEqual([2, 2]);
+});
+
 // anToSquare
 [
     ['a8', 0],
@@ -65,6 +122,39 @@ beforeEach(() => {
     });
 });
 
+// attackMap
+[
+    [START_FEN, '', 0, false, {40: 2, 42: 3, 45: 3, 51: 4, 52: 4, 59: 1, 80: 2, 82: 3, 85: 3}],
+    [START_FEN, 'e4 d5 exd5 Qxd5 Nc3', 0, false, {}],
+    [START_FEN, 'e4 d5 exd5 Qxd5 Nc3', 0, true, {}],
+    [START_FEN, 'e4 d5 exd5 Qxd5 Nc3', 5, false, {40: 2, 42: 3, 45: 3, 51: 4, 52: 4, 59: 1, 80: 2, 82: 3, 85: 3}],
+    [START_FEN, 'e4 d5 exd5 Qxd5 Nc3', 5, true, {40: 2, 42: 3, 45: 3, 51: 4, 52: 4, 59: 1, 80: 2, 82: 3, 85: 3}],
+    ['r1bqkb1r/pppp1ppp/2n2n2/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4', 'O-O', 0, true, {}],
+    ['1r2kb1r/pb1p1p2/1p1q2pn/7p/1PB1P3/3NQ2P/P2N1PP1/1R1K3R w HB - 0 20', 'O-O-O', 0, true, {}],
+    ['5k2/8/8/8/6pP/8/6K1/8 b - h3 0 17', 'gxh3+', 0, true, {}],
+    ['r3k3/1P6/8/8/8/8/8/4K3 w q - 0 1', 'bxa8=Q+', 0, true, {}],
+].forEach(([fen, moves, steps, track, dico], id) => {
+    test(`attackMap:${id}`, () => {
+        chess.trackAttacks(track);
+        chess.load(fen, true);
+        chess.attackMap();
+        if (moves) {
+            for (let move of moves.split(' '))
+                chess.moveSan(move, false, false);
+        }
+        for (let i = 0; i < steps; i ++)
+            chess.undo();
+        let answer = new Uint8Array(chess.attackMap());
+        Keys(dico).forEach(key => {
+            expect(answer[key]).toEqual(dico[key]);
+        });
+        // the incremental map must match a map computed from scratch
+        chess.trackAttacks(false);
+        chess.load(chess.fen(), true);
+        expect(chess.attackMap()).toEqual(answer);
+    });
+});
+
 // attacks
 [
     ['1r3b1k/2q3pP/p2pbp2/4n2P/r2BP3/2N5/1PP1BQ2/2KR1R2 b - -', [0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 10, 5, 10, 0]],
@@ -80,6 +170,20 @@ beforeEach(() => {
     });
 });
 
+// bitbase
+[
+    ['KPK', 24576],
+    ['KQK', 16384],
+    ['KRK', 16384],
+    ['KKQ', 0],
+    ['KQKR', 0],
+    ['KQRBK', 0],
+].forEach(([code, answer], id) => {
+    test(`bitbase:${id}`, () => {
+        expect(chess.bitbase(code)).toEqual(answer);
+    });
+});
+
 // board
 [
     ['8/8/8/8/8/8/8/8 w - - 0 1', 128, {127: 0}],
@@ -121,6 +225,64 @@ beforeEach(() => {
     });
 });
 
+// bookKey
+[
+    [START_FEN, '463b96181691fc9c'],
+    ['rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1', '823c9b50fd114196'],
+    ['rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2', '0756b94461c50fb0'],
+    ['rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2', '662fafb965db29d4'],
+    ['rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3', '22a48b5a8e47ff78'],
+    ['rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR b kq - 0 3', '652a607ca3f242c1'],
+    ['rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4', '00fdd303c946bdd9'],
+    ['rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3', '3c8123ea7b067637'],
+    ['rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4', '5c3f9b829b279560'],
+].forEach(([fen, answer], id) => {
+    test(`bookKey:${id}`, () => {
+        expect(book.key(fen)).toEqual(answer);
+    });
+});
+
+// bookMoves
+[
+    [START_FEN, '463b96181691fc9c', [[405, 3], [796, 7]], [['Nf3', 3], ['e4', 7]]],
+    ['r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1', 'fda239cc692a6053', [[263, 5], [261, 1]], [['O-O', 5], ['Kf1', 1]]],
+    ['r3k2r/8/8/8/8/8/8/R3K2R b KQkq - 0 1', '05741f66c60de55a', [[263, 5]], []],
+].forEach(([fen, key, entries, answer], id) => {
+    test(`bookMoves:${id}`, () => {
+        expect(book.key(fen)).toEqual(key);
+
+        let data = new Uint8Array(entries.length * 16);
+        entries.forEach(([move, weight], i) => {
+            for (let j = 0; j < 8; j ++)
+                data[i * 16 + j] = parseInt(key.slice(j * 2, j * 2 + 2), 16);
+            data.set([move >> 8, move & 255, weight >> 8, weight & 255], i * 16 + 8);
+        });
+        expect(book.load(data)).toEqual(entries.length);
+
+        let moves = book.moves(fen);
+        expect(ArrayJS(moves).map(move => [move.m, move.score])).toEqual(answer);
+    });
+});
+
+// bookPick
+[
+    [0, 'd4'],
+    [0.3, 'd4'],
+    [0.34, 'e4'],
+    [0.99, 'e4'],
+].forEach(([random, answer], id) => {
+    test(`bookPick:${id}`, () => {
+        expect(book.add([
+            '[Result "1-0"]\n\n1. e4 e5 1-0\n',
+            '[Result "0-1"]\n\n1. e4 c5 0-1\n',
+            '[Result "1/2-1/2"]\n\n1. d4 d5 1/2-1/2\n',
+            '[Result "*"]\n\n1. c4 *\n',
+        ].join('\n'), 1)).toEqual(4);
+        expect(book.build().length).toEqual(2 * 16);
+        expect(book.pick(START_FEN, random).m).toEqual(answer);
+    });
+});
+
 // castling
 [
     ['8/8/8/8/8/8/8/8 w - - 0 1', [255, 255, 255, 255]],
@@ -223,6 +385,47 @@ beforeEach(() => {
     });
 });
 
+// decodeGame
+[
+    [
+        'Event\tTCEC\nRound\t1.1\n', '1. e4 e5 2. Nf3!? Nc6 3. Bb5 a6 4. Bxc6 dxc6 5. O-O f6', 1,
+        '0.3 0.25 - -0.1 0.5 0.4 1.2 0.9 0.8 M5', '20 21 22 23 24 25 26 27 28 -', '1000 2000 - 4000 5000 6000 7000 8000 9000 123456',
+        ['e4', 'e5', 'Nf3', 'Nc6', 'Bb5', 'a6', 'Bxc6', 'dxc6', 'O-O', 'f6'],
+        [
+            30, 20, 1000, 25, 21, 2000, 31002, 22, -1, -10, 23, 4000, 50, 24, 5000,
+            40, 25, 6000, 120, 26, 7000, 90, 27, 8000, 80, 28, 9000, 31002, -1, 123456,
+        ],
+    ],
+    [
+        'FEN\trnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2\n', 'Qh5 Nc6 Bc4 Nf6 Qxf7#', 2, '', '', '',
+        ['Qh5', 'Nc6', 'Bc4', 'Nf6', 'Qxf7#'],
+        [31002, -1, -1, 31002, -1, -1, 31002, -1, -1, 31002, -1, -1, 31002, -1, -1],
+    ],
+    ['', '1. d4 Nf6 2. Ke3', 0, '', '', '', null, []],
+].forEach(([headers, multi, result, evals, depths, times, answer, columns], id) => {
+    test(`decodeGame:${id}`, () => {
+        let data = Array.from(chess.encodeGame(headers, multi, result, evals, depths, times));
+        // invalid move => nothing is encoded
+        if (!answer) {
+            expect(data).toEqual([]);
+            expect(chess.decodeGame(new Uint8Array(data), false)).toEqual(-1);
+            return;
+        }
+        expect(data[1]).toEqual(result);
+        expect(data.length).toBeLessThan(headers.length + multi.length + 8 * answer.length);
+
+        let count = chess.decodeGame(new Uint8Array(data), false),
+            moves = Array.from(chess.replayMoves()),
+            records = Array.from(chess.pgnGames()),
+            text = String.fromCharCode(...chess.replayText());
+        expect(count).toEqual(answer.length);
+        expect(records.slice(2, 5)).toEqual([0, answer.length, result]);
+        expect(text.slice(records[0], records[1])).toEqual(headers);
+        expect(answer.map((_, i) => text.slice(moves[i * 8 + 6], moves[i * 8 + 7]))).toEqual(answer);
+        expect(Array.from(chess.gameColumns())).toEqual(columns);
+    });
+});
+
 // decorateSan
 [
     ['8/5Np1/3k4/p2p4/6P1/7P/1Pn2K2/8 b - - 6 47', 'Nf7', 'Nf7+'],
@@ -249,6 +452,36 @@ beforeEach(() => {
     });
 });
 
+// ecoClassify
+[
+    ['', '1. d4 Nf6 2. c4 e6 3. Nc3 Bb4', "E00\tIndian Defense: East Indian Defense"],
+    ['', '1. c4 Nf6 2. d4', "A50\tIndian Defense: Normal Variation"],
+    ['', '1. c4 e6 2. d4 Nf6', "E00\tIndian Defense: East Indian Defense"],
+    ['', '1. e4 e5 2. Nf3 Nc6 3. Bb5 a6', 'C60\tRuy Lopez'],
+    ['', '1. Nf3 d5', ''],
+    ['rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2', '', "C20\tKing's Pawn Game"],
+].forEach(([fen, multi, answer], id) => {
+    test(`ecoClassify:${id}`, () => {
+        eco.reset();
+        expect(eco.load([
+            'eco\tname\tpgn',
+            "A40\tQueen's Pawn Game\t1. d4",
+            'A45\tIndian Defense\t1. d4 Nf6',
+            'A50\tIndian Defense: Normal Variation\t1. d4 Nf6 2. c4',
+            'E00\tIndian Defense: East Indian Defense\t1. d4 Nf6 2. c4 e6',
+            "C20\tKing's Pawn Game\t1. e4 e5",
+            'C60\tRuy Lopez\t1. e4 e5 2. Nf3 Nc6 3. Bb5',
+            'X00\tInvalid\t1. e4 e5 2. Ke3',
+        ].join('\n'))).toEqual(6);
+        expect(eco.name(eco.classify(fen, multi))).toEqual(answer);
+
+        let pgn = `${fen? `[FEN "${fen}"]\n\n`: ''}${multi} *\n`,
+            ids = eco.games(pgn);
+        expect(ids.size()).toEqual(1);
+        expect(eco.name(ids.get(0))).toEqual(answer);
+    });
+});
+
 // evaluate
 [
     ['7k/2q3bP/p2pbp2/r3n3/3QP3/2N5/2P1B3/3RK1R1 b - - 0 33', 'e=nul', [0, 0]],
@@ -260,6 +493,16 @@ beforeEach(() => {
     ['3Q4/6qk/p7/4n3/2N5/r7/4B3/3bK3 w - - 0 40', 'e=mob', [220, 220]],
     ['3Q4/6qk/p7/4n3/2N5/r7/4B3/3bK3 w - - 0 40', 'e=hce', [-2281, -2281]],
     ['3Q4/6qk/p7/4n3/2N5/r7/4B3/3bK3 w - - 0 40', 'e=att', [-2244, -2244]],
+    ['8/5q2/8/3K4/8/8/8/7k w - - 0 1', 'e=mat', [-20000, -10000]],
+    ['8/5r2/8/3K4/8/8/8/7k b - - 0 1', 'e=hce', [10000, 20000]],
+    ['8/5n2/8/3K4/8/8/b7/7k w - - 0 1', 'e=mat', [-20000, -10000]],
+    ['8/8/8/3K4/8/8/8/4NN1k w - - 0 1', 'e=hce', [0, 0]],
+    ['8/8/8/3K4/8/8/8/5B1k w - - 0 1', 'e=hce', [0, 0]],
+    ['k7/8/8/8/8/8/P7/K7 w - - 0 1', 'e=hce', [0, 0]],
+    ['8/8/8/8/k7/8/6P1/6K1 w - - 0 1', 'e=mat', [10000, 20000]],
+    ['8/8/8/8/8/8/6P1/k5K1 b - - 0 1', 'e=mat', [-20000, -10000]],
+    ['7k/8/6K1/7P/8/8/8/3B4 w - - 0 1', 'e=hce', [0, 0]],
+    ['7k/8/6K1/7P/8/8/8/2B5 w - - 0 1', 'e=hce', [1, 10000]],
 ].forEach(([fen, options, answer], id) => {
     test(`evaluate:${id}`, () => {
         chess.configure(false, options, 1);
@@ -271,6 +514,125 @@ beforeEach(() => {
     });
 });
 
+// evaluateBatch
+[
+    [[START_FEN, '8/8/8/8/8/8/6P1/k5K1 b - - 0 1'], 'e=hce', 0, 1, [48, -10461]],
+    [
+        [START_FEN, 'r1bqkbnr/pppp1ppp/2n5/4p3/3PP3/5N2/PPP2PPP/RNBQKB1R b KQkq d3 0 3', '', 'invalid', '8/8/8/8/8/8/8/8 w - - 0 1'],
+        'e=hce', 0, 0, [48, 134, 31002, 31002],
+    ],
+    [
+        [START_FEN, 'rnbqkbnr/pppp1ppp/8/4p3/3P4/8/PPP1PPPP/RNBQKBNR w KQkq e6 0 2'],
+        'e=hce', 2, 2, [48, 96, 48, 171],
+    ],
+].forEach(([fens, options, quiesce, threads, answer], id) => {
+    test(`evaluateBatch:${id}`, () => {
+        chess.configure(false, options, 0);
+        expect(chess.evaluateBatch(fens.join('\r\n'), false, quiesce, threads)).toEqual(new Int32Array(answer));
+
+        // packed positions give the same result
+        let data = [];
+        fens.filter(fen => fen.split('/').length == 8).forEach(fen => {
+            chess.load(fen, false);
+            data.push(...chess.packPosition());
+        });
+        let results = chess.evaluateBatch(new Uint8Array(data), true, quiesce, threads),
+            valids = answer.filter(score => score != 31002);
+        expect(Array.from(results).filter(score => score != 31002)).toEqual(valids);
+    });
+});
+
+// evaluateBatchSearch
+[
+    [START_FEN, 'e=hce'],
+    ['r1bqkbnr/pppp1ppp/2n5/4p3/3PP3/5N2/PPP2PPP/RNBQKB1R b KQkq d3 0 3', 'e=hce'],
+    ['8/8/8/8/8/8/6P1/k5K1 b - - 0 1', 'e=hce'],
+    ['7k/8/6K1/7P/8/8/8/2B5 w - - 0 1', 'e=hce'],
+    ['6k1/5ppp/8/8/8/8/1R3PPP/3B2K1 w - - 0 1', 'e=hce'],
+].forEach(([fen, options], id) => {
+    test(`evaluateBatchSearch:${id}`, () => {
+        chess.configure(false, options, 1);
+        chess.load(fen, false);
+        chess.search(ArrayJS(chess.moves()).join(' '), '', false);
+        chess.moves();
+        let score = chess.evaluate();
+        expect(chess.evaluateBatch(fen, false, 0, 1)).toEqual(new Int32Array([score]));
+    });
+});
+
+// evaluateTrace
+[
+    [START_FEN, 'e=att', 159, [0, 0, 111, 0, 0, 0, 0, 0, 9128, 9128, 48, 0, 0, 0, 0, 0, 64, 64]],
+    [
+        'r1bqkbnr/pppp1ppp/2n5/4p3/3PP3/5N2/PPP2PPP/RNBQKB1R b KQkq d3 0 3', 'e=paw', 270,
+        [0, 6, 0, 130, 0, 0, 0, 0, 9128, 9128, 0, 134, 75, 75, 0, 0, 64, 64],
+    ],
+    ['8/8/8/8/8/8/6P1/k5K1 b - - 0 1', 'e=hce', -10461, [0, 0, 0, 0, 10461, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0]],
+    ['7k/8/6K1/7P/8/8/8/2B5 w - - 0 1', 'e=hce', 3599, [0, 0, 0, 0, 0, 0, 25, -230, 1513, -300, 0, 0, 0, 0, 1531, 0, 64, 64]],
+].forEach(([fen, options, score, answer], id) => {
+    test(`evaluateTrace:${id}`, () => {
+        chess.configure(false, options, 0);
+        chess.load(fen, false);
+        chess.moves();
+        expect(chess.evaluateTrace()).toEqual(score);
+        expect(chess.evaluate()).toEqual(score);
+        expect(chess.trace()).toEqual(new Int32Array(answer));
+    });
+});
+
+// explorerQuery
+[
+    [
+        START_FEN,
+        [100, 68, 0, 3, 1, 1, 0, 0.4, 99, 67, 0, 1, 0, 0, 1, 0.2],
+    ],
+    [
+        'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1',
+        [20, 52, 0, 2, 1, 0, 0, 0.25, 18, 50, 0, 1, 0, 1, 0, 0.35],
+    ],
+    ['rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2', [118, 85, 0, 1, 1, 0, 0, 0.4]],
+    ['rnbqkbnr/pppp1ppp/8/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R b KQkq - 1 2', []],
+    ['rnbqkbnr/pppppppp/8/8/3P4/8/PPP1PPPP/RNBQKBNR b KQkq d3 0 1', [19, 51, 0, 1, 0, 0, 1, 'nan']],
+].forEach(([fen, answer], id) => {
+    test(`explorerQuery:${id}`, () => {
+        explorer.reset();
+        expect(explorer.add([
+            '[Result "1-0"]\n\n1. e4 {d=20, wv=0.30} e5 {wv=0.25, d=18} 2. Nf3 {wv=0.40} Nc6 1-0\n',
+            '[Result "1/2-1/2"]\n\n1. e4 {d=21,\nwv=0.50} c5 {wv=0.35} 2. Nf3 d6 1/2-1/2\n',
+        ].join('\n'), 3)).toEqual(2);
+        let data = new Uint8Array(explorer.build());
+        expect(String.fromCharCode(...data.slice(0, 4))).toEqual('TPEX');
+        expect(explorer.load(data)).toEqual(5);
+        expect(explorer.add([
+            '[Result "0-1"]\n\n1. d4 {wv=0.20} d5 {wv=-M5} 0-1\n',
+            '[Result "*"]\n\n1. e4 e5 (1... c5 {wv=9.9}) *\n',
+        ].join('\n'), 3)).toEqual(2);
+        expect(explorer.load(new Uint8Array(explorer.build()))).toEqual(7);
+
+        expect(explorer.query(fen)).toEqual(answer.length / 8);
+        let results = Array.from(explorer.results()).map(value => isNaN(value)? 'nan': Math.round(value * 100) / 100);
+        expect(results).toEqual(answer);
+    });
+});
+
+// explorerQuery transposition
+[
+    'rnbqkbnr/ppp2ppp/4p3/3p4/2PP4/8/PP2PPPP/RNBQKBNR w KQkq d6 0 3',
+    'rnbqkbnr/ppp2ppp/4p3/3p4/2PP4/8/PP2PPPP/RNBQKBNR w KQkq - 0 3',
+].forEach((fen, id) => {
+    test(`explorerQuery:transposition:${id}`, () => {
+        explorer.reset();
+        expect(explorer.add([
+            '[Result "1-0"]\n\n1. d4 d5 2. c4 e6 3. Nc3 1-0\n',
+            '[Result "0-1"]\n\n1. c4 e6 2. d4 d5 3. cxd5 0-1\n',
+        ].join('\n'), 5)).toEqual(2);
+        explorer.build();
+        expect(explorer.query(fen)).toEqual(2);
+        let results = Array.from(explorer.results()).map(value => isNaN(value)? 'nan': value);
+        expect(results).toEqual([66, 51, 0, 1, 0, 0, 1, 'nan', 113, 82, 0, 1, 1, 0, 0, 'nan']);
+    });
+});
+
 // fen
 [
     [
@@ -307,11 +669,15 @@ beforeEach(() => {
     ],
     ['8/2pk4/p2p4/8/1P6/1KP4r/8/R7 w - - 42 80', 'Rxa6', '8/2pk4/R2p4/8/1P6/1KP4r/8/8 b - - 0 80'],
     ['8/2pk4/p2p4/8/1P6/1KP4r/8/R7 w - - 42 80', 'Rxa6 d5', '8/2pk4/R7/3p4/1P6/1KP4r/8/8 w - - 0 81'],
+    [START_FEN, 'e4 Nf6 e5 d5 exd6', 'rnbqkb1r/ppp1pppp/3P1n2/8/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 3'],
 ].forEach(([fen, moves, answer], id) => {
     test(`fen:${id}`, () => {
         chess.load(fen, false);
-        for (let move of moves.split(' '))
+        // intermediate FENs: only the changed ranks are rebuilt
+        for (let move of moves.split(' ')) {
             chess.moveSan(move, false, false);
+            chess.fen();
+        }
         expect(chess.fen()).toEqual(Undefined(answer, fen));
     });
 });
@@ -336,15 +702,15 @@ beforeEach(() => {
     [START_FEN, 'h=1 s=mm', 1, [1, 0]],
     [START_FEN, 'h=1 s=mm', 2, [21, 0]],
     [START_FEN, 'h=1 s=mm', 3, [421, 0]],
-    [START_FEN, 'h=1 s=mm', 4, [[8158, 8213], [1113, 1165]]],
+    [START_FEN, 'h=1 s=mm', 4, [[8111, 8213], [1113, 1212]]],
     [START_FEN, 's=ab', 4, [0, 0]],
-    [START_FEN, 'h=1 s=ab', 1, [21, [18, 19]]],
-    [START_FEN, 'h=1 s=ab', 2, [[3, 60], [32, 38]]],
+    [START_FEN, 'h=1 s=ab', 1, [21, [18, 20]]],
+    [START_FEN, 'h=1 s=ab', 2, [[3, 60], [32, 39]]],
     [START_FEN, 'h=1 s=ab', 3, [524, [424, 438]]],
-    [START_FEN, 'h=1 s=ab', 4, [[1341, 1380], [247, 264]]],
-    [START_FEN, 'h=1 s=ab', 5, [[13567, 14790], [2698, 3030]]],
-    [START_FEN, 'h=1 s=ab', 6, [[187373, 189109], [19171, 20121]]],
-    [START_FEN, 'h=1 s=ab', 7, [[40169, 304719], [53562, 60648]]],
+    [START_FEN, 'h=1 s=ab', 4, [[1341, 1380], [247, 270]]],
+    [START_FEN, 'h=1 s=ab', 5, [[13559, 14790], [2698, 3030]]],
+    [START_FEN, 'h=1 s=ab', 6, [[185519, 189109], [19171, 22851]]],
+    [START_FEN, 'h=1 s=ab', 7, [[40169, 304719], [53562, 66644]]],
 ].forEach(([fen, options, depth, answer], id) => {
     test(`hashStats:${id}`, () => {
         chess.configure(false, options, depth);
@@ -365,6 +731,77 @@ beforeEach(() => {
     });
 });
 
+// indexQuery
+[
+    ['rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1', []],
+    ['rnbqkbnr/pppppppp/8/8/8/5N2/PPPPPPPP/RNBQKB1R b KQkq - 1 1', [10, 0]],
+    ['r1bqkb1r/pppppppp/2n2n2/8/8/2N2N2/PPPPPPPP/R1BQKB1R w KQkq - 4 3', [10, 3, 11, 3]],
+    ['rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2', [12, 1]],
+    ['rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2', [12, 1]],
+    ['rnbqkbnr/ppp2ppp/4p3/3p4/2PP4/8/PP2PPPP/RNBQKBNR w KQkq d6 0 3', [13, 3, 14, 3]],
+    ['rnbqkbnr/ppp2ppp/4p3/3p4/2PP4/8/PP2PPPP/RNBQKBNR w KQkq - 0 3', [13, 3, 14, 3]],
+].forEach(([fen, answer], id) => {
+    test(`indexQuery:${id}`, () => {
+        let pgn = [
+            '[Event "A"]\n\n1. Nf3 Nf6 2. Nc3 Nc6 *\n',
+            '[Event "B"]\n\n1. Nc3 Nc6 2. Nf3 Nf6 *\n',
+            '[Event "C"]\n\n1. e4 e5 *\n',
+            '[Event "D"]\n\n1. d4 d5 2. c4 e6 *\n',
+            '[Event "E"]\n\n1. c4 e6 2. d4 d5 *\n',
+        ].join('\n');
+        expect(index.add(pgn, 10)).toEqual(5);
+        let data = new Uint8Array(index.build());
+        expect(String.fromCharCode(...data.slice(0, 4))).toEqual('TPIX');
+        expect(index.query(fen)).toEqual(answer.length / 2);
+        expect(Array.from(index.results())).toEqual(answer);
+
+        // in-memory buffer, ex: fetched from the server
+        index.add('', 0);
+        index.build();
+        expect(index.load(data)).toEqual(18);
+        expect(index.query(fen)).toEqual(answer.length / 2);
+        expect(Array.from(index.results())).toEqual(answer);
+    });
+});
+
+// isLegal
+[
+    [START_FEN, {from: 100, to: 68}, true],
+    [START_FEN, {from: 100, to: 52}, false],
+    [START_FEN, {from: 113, to: 82}, true],
+    [START_FEN, {from: 20, to: 36}, false],
+    ['r1bqkbnr/ppp2ppp/2n5/1B1pP3/4P3/8/PPPP2PP/RNBQK1NR b KQkq - 2 4', {from: 34, to: 20}, false],
+    ['r1bqkbnr/ppp2ppp/2n5/1B1pP3/4P3/8/PPPP2PP/RNBQK1NR b KQkq - 2 4', {from: 6, to: 20}, true],
+    ['r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1', {flag: 1, from: 116, to: 119}, true],
+    ['r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1', {from: 116, to: 119}, false],
+    ['r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1', {capture: 1, from: 51, to: 36}, true],
+    ['r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1', {from: 51, to: 36}, false],
+    ['r3k3/1P6/8/8/8/8/8/4K3 w q - 0 1', {from: 17, promote: 5, to: 1}, true],
+    ['r3k3/1P6/8/8/8/8/8/4K3 w q - 0 1', {from: 17, to: 1}, false],
+].forEach(([fen, move, answer], id) => {
+    test(`isLegal:${id}`, () => {
+        chess.load(fen, false);
+        move = Assign({capture: 0, depth: 0, fen: '', flag: 0, from: 0, m: '', ply: 0, promote: 0, pv: '', score: 0, to: 0}, move);
+        expect(chess.isLegal(chess.packObject(move))).toEqual(answer);
+    });
+});
+
+// leastAttacker
+[
+    [START_FEN, 0, 68, 255],
+    [START_FEN, 0, 99, 113],
+    ['r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1', 0, 3, 255],
+    ['r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1', 0, 36, 51],
+    ['r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1', 0, 37, 85],
+    ['r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1', 1, 51, 36],
+    ['r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1', 1, 100, 32],
+].forEach(([fen, color, square, answer], id) => {
+    test(`leastAttacker:${id}`, () => {
+        chess.load(fen, false);
+        expect(chess.leastAttacker(color, square)).toEqual(answer);
+    });
+});
+
 // load
 [
     ['rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -', false, '', undefined, START_FEN, 0],
@@ -383,14 +820,14 @@ beforeEach(() => {
         true, 'd4',
         undefined,
         'rnbqkbnr/pppppppp/8/8/3P4/8/PPP1PPPP/RNBQKBNR b KQkq d3 0 1',
-        [1985588709, 2344719164],
+        [1985588709, 2342607200],
     ],
     [
         START_FEN,
         true, 'd4 d5',
         undefined,
         'rnbqkbnr/ppp1pppp/8/3p4/3P4/8/PPP1PPPP/RNBQKBNR w KQkq d6 0 2',
-        [2773017983, 3259486411],
+        [2773017983, 2147290828],
     ],
     [
         'r3k2r/pppppppp/8/8/8/8/PPPPPPPP/R3K2R w KQkq - 0 1',
@@ -418,7 +855,7 @@ beforeEach(() => {
         true, 'dxc6',
         undefined,
         'rnbqkb1r/pp1ppppp/2P2n2/8/8/8/PPP1PPPP/RNBQKBNR b KQkq - 0 3',
-        [2504863392, 930110334],
+        [2504863392, 546453751],
     ],
     [
         'rnbqk2r/ppPpppbp/5np1/8/8/8/PPP1PPPP/RNBQKBNR w KQkq - 1 5',
@@ -843,6 +1280,36 @@ beforeEach(() => {
     });
 });
 
+// multiSanPacked
+[
+    [START_FEN, '1. d4 d5 2. c4', false, true],
+    [START_FEN, '1. e4 d5 2. exd5 Qxd5 3. Nc3 Qa5 4. d4 c6 5. Nf3 Bg4 6. Bf4 e6 7. h3 Bxf3 8. Qxf3 Bb4 9. Be2 Nd7 10. a3 O-O-O', false, true],
+    [START_FEN, '1. e4 d5 2. exd5 Qxd5', false, false],
+    ['r1bqkb1r/pppp1ppp/2n2n2/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4', 'O-O Nxe4 Re1', false, true],
+].forEach(([fen, multi, sloppy, create_fen], id) => {
+    test(`multiSanPacked:${id}`, () => {
+        chess.load(fen, false);
+        let answer = ArrayJS(chess.multiSan(multi, sloppy, create_fen)),
+            new_fen = chess.fen();
+
+        chess.load(fen, false);
+        let count = chess.multiSanPacked(multi, sloppy, create_fen),
+            moves = Array.from(chess.replayMoves()),
+            text = String.fromCharCode(...chess.replayText());
+        expect(count).toEqual(answer.length);
+        expect(moves.length).toEqual(count * 8);
+        answer.forEach((obj, id) => {
+            let [from, to, flag, capture, promote, ply, san, fen] = moves.slice(id * 8, id * 8 + 8),
+                end = (id < count - 1)? moves[id * 8 + 14]: text.length;
+            expect({capture, flag, from, ply, promote, to}).toEqual(
+                {capture: obj.capture, flag: obj.flag, from: obj.from, ply: obj.ply, promote: obj.promote, to: obj.to});
+            expect(text.slice(san, fen)).toEqual(obj.m);
+            expect(text.slice(fen, end)).toEqual(obj.fen);
+        });
+        expect(chess.fen()).toEqual(new_fen);
+    });
+});
+
 // multiUci
 [
     [
@@ -897,6 +1364,71 @@ beforeEach(() => {
     });
 });
 
+// multiUciBatch
+[
+    [START_FEN, ['d2d4 d7d5 c2c4', 'e2e4 e7e5 g1f3 b8c6', 'e2e4 c7c5 e9e5 g1f3', '', 'g1f3']],
+    ['r1b2r1k/p2P1p1p/3NP1p1/2p3b1/5Pn1/2q3P1/p2Q3P/1R3RK1 w - - 0 26', ['d7c8q a2b1q', 'f1f2 a2b1n', 'e6f7 f8f7 d6f7']],
+    ['rknrbqnb/pppppppp/8/8/8/8/PPPPPPPP/RKNRBQNB w DAda - 0 1', ['1. d2d4 g8f6 2. c1b3 c8b6 3. e2e4', 'b1a1']],
+].forEach(([fen, multis], id) => {
+    test(`multiUciBatch:${id}`, () => {
+        chess.load(fen, false);
+        let root = chess.fen(),
+            answers = multis.map(multi => {
+                chess.load(fen, false);
+                return ArrayJS(chess.multiUci(multi));
+            });
+
+        let counts = ArrayJS(chess.multiUciBatch(fen, multis.join('\n'))),
+            moves = Array.from(chess.replayMoves()),
+            text = String.fromCharCode(...chess.replayText()),
+            total = moves.length / 8,
+            index = 0;
+        expect(counts).toEqual(answers.map(answer => answer.length));
+        answers.forEach(answer => {
+            answer.forEach(obj => {
+                let [from, to, flag, capture, promote, ply, san, fen] = moves.slice(index * 8, index * 8 + 8),
+                    end = (index < total - 1)? moves[index * 8 + 14]: text.length;
+                expect({capture, flag, from, ply, promote, to}).toEqual(
+                    {capture: obj.capture, flag: obj.flag, from: obj.from, ply: obj.ply, promote: obj.promote, to: obj.to});
+                expect(text.slice(san, fen)).toEqual(obj.m);
+                expect(text.slice(fen, end)).toEqual(obj.fen);
+                index ++;
+            });
+        });
+        expect(index).toEqual(total);
+        expect(chess.fen()).toEqual(root);
+    });
+});
+
+// multiUciPacked
+[
+    [START_FEN, 'd2d4 d7d5 c2c4'],
+    [START_FEN, 'e2e4 d7d5 e4d5 d8d5 b1c3 d5a5 d2d4 c7c6 g1f3 c8g4 c1f4 e7e6 h2h3 g4f3 d1f3 f8b4 f1e2 b8d7 a2a3 e8c8'],
+    [START_FEN, 'd6d7 d7d6'],
+    ['rknrbqnb/pppppppp/8/8/8/8/PPPPPPPP/RKNRBQNB w DAda - 0 1', '1. d2d4q g8f6q 2. c1b3q c8b6q 3. e2e4q'],
+].forEach(([fen, multi], id) => {
+    test(`multiUciPacked:${id}`, () => {
+        chess.load(fen, false);
+        let answer = ArrayJS(chess.multiUci(multi)),
+            new_fen = chess.fen();
+
+        chess.load(fen, false);
+        let count = chess.multiUciPacked(multi),
+            moves = Array.from(chess.replayMoves()),
+            text = String.fromCharCode(...chess.replayText());
+        expect(count).toEqual(answer.length);
+        answer.forEach((obj, id) => {
+            let [from, to, flag, capture, promote, ply, san, fen] = moves.slice(id * 8, id * 8 + 8),
+                end = (id < count - 1)? moves[id * 8 + 14]: text.length;
+            expect({capture, flag, from, ply, promote, to}).toEqual(
+                {capture: obj.capture, flag: obj.flag, from: obj.from, ply: obj.ply, promote: obj.promote, to: obj.to});
+            expect(text.slice(san, fen)).toEqual(obj.m);
+            expect(text.slice(fen, end)).toEqual(obj.fen);
+        });
+        expect(chess.fen()).toEqual(new_fen);
+    });
+});
+
 // nodes
 [
     ['8/7b/8/2k3P1/p3K3/8/1P6/8 w - - 0 1', 's=mm', 1, true, 'e4e3 e4e5 e4f3 e4f4 g5g6'],
@@ -986,6 +1518,29 @@ beforeEach(() => {
     });
 });
 
+// packPosition
+[
+    [
+        '8/8/8/8/8/8/6P1/k5K1 b - - 12 1',
+        [
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 14, 0, 0, 6, 1, 12, 255, 255, 255, 255,
+        ],
+    ],
+    [
+        'r1bqkbnr/pppp1ppp/2n5/4p3/3PP3/5N2/PPP2PPP/RNBQKB1R b KQkq d3 0 3',
+        [
+            12, 219, 190, 202, 153, 153, 144, 153, 0, 10, 0, 0, 0, 0, 9, 0,
+            0, 16, 1, 0, 0, 0, 32, 0, 17, 1, 16, 17, 36, 83, 54, 64, 65, 0, 119, 112, 7, 0,
+        ],
+    ],
+].forEach(([fen, answer], id) => {
+    test(`packPosition:${id}`, () => {
+        chess.load(fen, false);
+        expect(chess.packPosition()).toEqual(new Uint8Array(answer));
+    });
+});
+
 // params
 [
     [false, 'd=5', 0, [5, 1, 1e9, 0, 0, 0]],
@@ -1001,6 +1556,110 @@ beforeEach(() => {
     });
 });
 
+// parseComments
+[
+    [
+        '',
+        [
+            '{WhiteEngineOptions: Protocol=uci; Hash=8192;}',
+            '1. d4 {book, mb=+0+0+0+0+0,} c5 {book, mb=+0+0+0+0+0,}',
+            '2. d5 d6 3. c4 g6 4. Nc3 Bg7 5. g3 Nf6 6. Bg2 O-O 7. Nf3 Na6 8. O-O Nc7',
+            '9. e4 {d=21, sd=57, mt=192630, tl=5217370, s=19738, n=3801954, pv=e4 b6 Bg5 Ba6 Qd3 e6 h3 Re8 Bh4 exd5, tb=0, h=8.0, ph=0.0, wv=0.72, R50=50,}',
+            'e5 {d=14, sd=63, mt=106883, tl=5303117, s=45929, n=48818131317, pv=e5 Qe2 b6, tb=2074, wv=-M12,}',
+            '(9... Nxe4 {d=1, wv=9.9}) 10. Ne1 {d=21, sd=62, pd=Qe2, mt=178275, pv=Ne1 Bd7 a4 Qh8 Nb5, wv=0.78} *',
+        ].join('\n'),
+        {
+            depth: [-1, -1, 21, 14, 21],
+            eval: [NaN, NaN, 0.72, -Infinity, 0.78],
+            node: [-1, -1, 3801954, 48818131317, -1],
+            ply: [0, 1, 16, 17, 18],
+            pv: ['', '', 'e4 b6 Bg5 Ba6 Qd3 e6 h3 Re8 Bh4 exd5', 'e5 Qe2 b6', 'Ne1 Bd7 a4 Qh8 Nb5'],
+            legal: [-1, -1, 10, 3, 3],
+            sel_depth: [-1, -1, 57, 63, 62],
+            speed: [-1, -1, 19738, 45929, -1],
+            tbhit: [-1, -1, 0, 2074, -1],
+            time: [-1, -1, 192630, 106883, 178275],
+            time_left: [-1, -1, 5217370, 5303117, -1],
+        },
+    ],
+    [
+        '8/8/8/8/k7/8/6P1/6K1 w - - 0 40',
+        '40. g4 {d=50, wv=M3, pv=g4 Kb5 g5} Kb5 {d=40, wv=-0.5, pv=Kb5 Kh2} 41. g5 {no eval}',
+        {
+            depth: [50, 40, -1],
+            eval: [Infinity, -0.5, NaN],
+            ply: [78, 79, 80],
+            pv: ['g4 Kb5 g5', 'Kb5 Kh2', ''],
+            legal: [3, 2, -1],
+        },
+    ],
+].forEach(([fen, text, answer], id) => {
+    [false, true].forEach(check_pv => {
+        test(`parseComments:${id}:${check_pv}`, () => {
+            let count = chess.parseComments(fen, text, check_pv),
+                pvs = Array.from(chess.comments('pv')),
+                source = String.fromCharCode(...chess.comments('text'));
+            expect(count).toEqual(answer.ply.length);
+            Keys(answer).forEach(key => {
+                if (key == 'legal')
+                    expect(pvs.filter((_, i) => i % 3 == 2)).toEqual(check_pv? answer.legal: answer.legal.map(() => -1));
+                else if (key == 'pv')
+                    expect(answer.pv.map((_, i) => source.slice(pvs[i * 3], pvs[i * 3 + 1]))).toEqual(answer.pv);
+                else if (key == 'eval')
+                    expect(Array.from(chess.comments(key)).map(value => isNaN(value)? 'nan': Math.round(value * 100) / 100))
+                        .toEqual(answer.eval.map(value => isNaN(value)? 'nan': value));
+                else
+                    expect(Array.from(chess.comments(key))).toEqual(answer[key]);
+            });
+        });
+    });
+});
+
+// parseInfos
+[
+    [
+        START_FEN,
+        [
+            '1612345678.123 Stockfish(1): info depth 20 seldepth 31 multipv 1 score cp 35 lowerbound nodes 3123456789 nps 2500000 hashfull 512 tbhits 7 time 1249 pv e2e4 e7e5 g1f3',
+            'info string NNUE evaluation enabled',
+            'readyok',
+            'info depth 21 score mate -3 pv d2d4 d7d5 e2e5 g8f6',
+            'info depth 22 currmove e2e4 currmovenumber 1',
+            'info nodes 100 pv e2e4 wdl 500 400 100 time 5',
+        ].join('\n'),
+        [
+            [0, 20, 31, 1, 35, 1, 1, 3123456789, 2500000, 512, 7, 1249, 3, 0],
+            [3, 21, -1, -1, -3, 2, 0, -1, -1, -1, -1, -1, 2, 3],
+            [4, 22, -1, -1, -1, 0, -1, -1, -1, -1, -1, -1, -1, -1],
+            [5, -1, -1, -1, -1, 0, -1, 100, -1, -1, -1, 5, 1, 5],
+        ],
+        ['e2e4 e7e5 g1f3', 'd2d4 d7d5', '', 'e2e4'],
+    ],
+].forEach(([fen, text, answer, multis], id) => {
+    test(`parseInfos:${id}`, () => {
+        let count = chess.parseInfos(fen, text, true),
+            records = Array.from(chess.infos()),
+            moves = Array.from(chess.replayMoves()),
+            text2 = String.fromCharCode(...chess.replayText()),
+            total = moves.length / 8;
+        expect(count).toEqual(answer.length);
+        for (let i = 0; i < count; i ++) {
+            let record = records.slice(i * 14, i * 14 + 14),
+                first = record[13];
+            expect(record).toEqual(answer[i]);
+
+            chess.load(fen, false);
+            let objs = ArrayJS(chess.multiUci(multis[i]));
+            objs.forEach((obj, j) => {
+                let index = first + j,
+                    end = (index < total - 1)? moves[index * 8 + 14]: text2.length;
+                expect(text2.slice(moves[index * 8 + 6], moves[index * 8 + 7])).toEqual(obj.m);
+                expect(text2.slice(moves[index * 8 + 7], end)).toEqual(obj.fen);
+            });
+        }
+    });
+});
+
 // perft
 // https://sites.google.com/site/numptychess/perft/position-1
 // http://www.rocechess.ch/perft.html
@@ -1123,6 +1782,53 @@ beforeEach(() => {
     });
 });
 
+// pgnFeed
+[
+    [
+        [
+            '[Event "TCEC \\"S20\\""]',
+            '[Round "1.1"]',
+            '',
+            '1. e4 {book} 1... c5 $1 2. Nf3 (2. Nc3 {x} (2. c3 d5) Nc6 ; line',
+            ') d6!? {d=24, wv=0.31,',
+            ' n=12345} 3. d4 cxd4 4.Nxd4 Nf6 5.Nc3 a6 1/2-1/2',
+            '',
+            '[FEN "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"]',
+            '% escaped line',
+            '1. 0-0 0-0-0 2. Rfd1 hxg2 1-0',
+            '',
+            '1. e4 e5 2. Ke3 Ke7 *',
+        ].join('\n'),
+        [
+            ['Event\tTCEC "S20"\nRound\t1.1\n', 'e4 c5 Nf3 d6 d4 cxd4 Nxd4 Nf6 Nc3 a6', 3, 1],
+            ['FEN\tr3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1\n', 'O-O O-O-O Rfd1 hxg2', 1, 1],
+            ['', 'e4 e5', 0, 0],
+        ],
+    ],
+].forEach(([pgn, answer], id) => {
+    [1, 7, 64, pgn.length].forEach(step => {
+        test(`pgnFeed:${id}:${step}`, () => {
+            let games = [];
+            chess.pgnReset(false);
+            for (let pos = 0; pos < pgn.length; pos += step) {
+                let count = chess.pgnFeed(pgn.slice(pos, pos + step), pos + step >= pgn.length),
+                    moves = Array.from(chess.replayMoves()),
+                    records = Array.from(chess.pgnGames()),
+                    text = String.fromCharCode(...chess.replayText());
+
+                for (let i = 0; i < count; i ++) {
+                    let [header, header_end, first, num_move, result, valid] = records.slice(i * 6, i * 6 + 6),
+                        sans = [];
+                    for (let j = first; j < first + num_move; j ++)
+                        sans.push(text.slice(moves[j * 8 + 6], moves[j * 8 + 7]));
+                    games.push([text.slice(header, header_end), sans.join(' '), result, valid]);
+                }
+            }
+            expect(games).toEqual(answer);
+        });
+    });
+});
+
 // piece
 [
     ['P', 1],
@@ -1142,6 +1848,32 @@ beforeEach(() => {
     });
 });
 
+// plyHashes
+[
+    [START_FEN, 'e2e4 c7c5', 0],
+    [START_FEN, 'e2e4 c7c5', 40],
+    ['rnbqk2r/pppppppp/8/8/8/8/PPPPPPPP/RNBQK2R w KQkq - 0 1', 'e1g1 a7a5', 35],
+].forEach(([fen, multi, repeat], id) => {
+    test(`plyHashes:${id}`, () => {
+        chess.load(fen, true);
+        let hashes = [],
+            moves = (multi + ' b1c3 b8c6 c3b1 c6b8'.repeat(repeat)).split(' ');
+        for (let move of moves) {
+            hashes.push(chess.boardHash() >>> 0);
+            chess.moveUci(move, false);
+        }
+
+        // the history grows past 128 plies, each entry is the position before the move
+        let result = chess.plyHashes();
+        expect(result.length).toEqual(moves.length);
+        expect(Array.from(result, hash => Number(BigInt.asUintN(32, hash)))).toEqual(hashes);
+
+        while (chess.undo());
+        expect(chess.boardHash() >>> 0).toEqual(hashes[0]);
+        expect(chess.plyHashes().length).toEqual(0);
+    });
+});
+
 // prepare
 [
     [
@@ -1184,6 +1916,25 @@ beforeEach(() => {
     });
 });
 
+// probe
+[
+    ['8/8/8/8/8/8/6P1/k5K1 b - - 0 1', '', -1],
+    ['8/8/8/8/8/8/6P1/k5K1 b - - 0 1', 'b=0', 31002],
+    ['8/8/8/8/8/k7/P7/K7 w - - 0 1', '', 0],
+    ['8/8/8/8/8/8/1q6/K1k5 w - - 0 1', '', -1],
+    ['7k/5Q2/6K1/8/8/8/8/8 b - - 0 1', '', 0],
+    ['8/8/8/3k4/8/8/8/R3K3 b - - 0 1', '', -1],
+    ['8/8/8/8/8/8/3k4/K3R3 b - - 0 1', '', 0],
+    ['8/8/8/3k4/8/8/8/KBN5 w - - 0 1', '', 31002],
+    [START_FEN, '', 31002],
+].forEach(([fen, options, answer], id) => {
+    test(`probe:${id}`, () => {
+        chess.configure(false, options, 0);
+        chess.load(fen, false);
+        expect(chess.probe()).toEqual(answer);
+    });
+});
+
 // put
 [
     [
@@ -1262,6 +2013,41 @@ beforeEach(() => {
         'Rd1', false,
         {capture: 0, fen: '', flag: 0, from: 0, m: '', ply: -2, promote: 0, pv: '', score: 0, to: 0},
     ],
+    [
+        'r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1',
+        'O-O-O', false,
+        {capture: 0, fen: '', flag: 1, from: 116, m: 'O-O-O', ply: 0, promote: 0, pv: '', score: 150, to: 112},
+    ],
+    [
+        'r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1',
+        'dxe6', false,
+        {capture: 1, fen: '', flag: 0, from: 51, m: 'dxe6', ply: 0, promote: 0, pv: '', score: 233, to: 36},
+    ],
+    [
+        'r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1',
+        'de6', false,
+        {capture: 0, fen: '', flag: 0, from: 0, m: '', ply: -2, promote: 0, pv: '', score: 0, to: 0},
+    ],
+    [
+        'r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1',
+        'Nf7', false,
+        {capture: 0, fen: '', flag: 0, from: 0, m: '', ply: -2, promote: 0, pv: '', score: 0, to: 0},
+    ],
+    [
+        '1Q2Q3/8/4k3/8/1Q2Q3/8/N3N3/K2N1N2 w - - 0 1',
+        'Qbe5', false,
+        {capture: 0, fen: '', flag: 0, from: 1, m: 'Qbe5', ply: 0, promote: 0, pv: '', score: 100, to: 52},
+    ],
+    [
+        '1Q2Q3/8/4k3/8/1Q2Q3/8/N3N3/K2N1N2 w - - 0 1',
+        'Qb8e5', false,
+        {capture: 0, fen: '', flag: 0, from: 0, m: '', ply: -2, promote: 0, pv: '', score: 0, to: 0},
+    ],
+    [
+        '1Q2Q3/8/4k3/8/1Q2Q3/8/N3N3/K2N1N2 w - - 0 1',
+        'Ndc3', false,
+        {capture: 0, fen: '', flag: 0, from: 115, m: 'Ndc3', ply: 0, promote: 0, pv: '', score: 120, to: 82},
+    ],
 ].forEach(([fen, san, sloppy, answer], id) => {
     test(`sanToObject:${id}`, () => {
         chess.load(fen, false);
@@ -1285,7 +2071,7 @@ beforeEach(() => {
     ['7k/3Q4/1p6/2p5/4K3/1P4PP/P6q/8 w - - 48 107', '', 3, [], {a2a3: 188, d7d8: 511, d7h7: -2345}],
     // 10
     ['8/6Q1/7p/7k/4P3/P2P2K1/8/8 w - - 0 75', '', 'd=2 e=mat s=mm', [], {g3h3: 0, g7g4: 30999}],
-    ['8/7R/8/4B3/P5N1/6P1/PKP3k1/7r b - - 48 96', '', 3, [], {h1b1: -4533, h1h7: -980}],
+    ['8/7R/8/4B3/P5N1/6P1/PKP3k1/7r b - - 48 96', '', 3, [], {h1b1: -13496, h1h7: -980}],
     ['bq1b1k1r/p1pp1r2/1p6/3Pp1Q1/4p1p1/1N6/PPP2PKP/B2R3R w h -', '', 'd=4 e=hce s=ab', [], {g5d2: -332, h2h4: -3005}],
     ['bq1b1k1r/p1pp1r2/1p6/3Pp1Q1/4p1p1/1N6/PPP2PKP/B2R3R w h -', '', 'd=4 e=hce s=mm', [], {g5d2: -332, h2h4: -3005}],
     ['r1b1kbnr/p2np2p/8/5p1P/8/N7/2P2qP1/4K1NR w kq - 0 16', '', 1, [], {1: 'e1f2'}],
@@ -1300,6 +2086,8 @@ beforeEach(() => {
     ['rnbqkbnr/p3ppQp/1p1p4/1N6/8/8/PPP1PPPP/R1B1KBNR b KQkq - 0 5', '', 1, 2434, {}],
     ['rnbqkbnr/p3ppQp/1p1p4/1N6/8/8/PPP1PPPP/R1B1KBNR b KQkq - 0 5', 'b8c6', 1, -160, {}],
     ['rnbqkbnr/p3ppQp/1p1p4/1N6/8/8/PPP1PPPP/R1B1KBNR b KQkq - 0 5', 'b8c6', 2, -1444, {}],
+    ['4k3/8/4K3/4P3/8/8/8/8 w - - 0 1', '', 'b=0 d=2 s=ab', [], {e6d5: 1165, e6d6: 10241}],
+    ['4k3/8/4K3/4P3/8/8/8/8 w - - 0 1', '', 'd=2 s=ab', [], {e6d6: 10421, e6f6: 10381}],
 ].forEach(([fen, mask, config, answer, checks], id) => {
     test(`search:${id}`, () => {
         let [frc, options, depth] =
@@ -1366,6 +2154,73 @@ beforeEach(() => {
     });
 });
 
+// signature
+[
+    [START_FEN, 'KQRRBBNNPPPPPPPPKQRRBBNNPPPPPPPP'],
+    ['8/5q2/8/3K4/8/8/8/7k w - - 0 1', 'KKQ'],
+    ['8/5n2/8/3K4/8/8/b7/7k w - - 0 1', 'KKBN'],
+    ['8/8/8/8/k7/8/6P1/6K1 w - - 0 1', 'KPK'],
+    ['8/8/8/8/k7/8/6P1/6K1 w - - 0 1', 'KQK', 'g2g4 a4b4 g4g5 b4c5 g5g6 c5d6 g6g7 d6e7 g7g8q'],
+    ['r1b2r1k/p2P1p1p/3NP1p1/2p3b1/5Pn1/2q3P1/p2Q3P/1R3RK1 w - - 0 26', 'KQQRRNPPPPKQRRBNPPPPPP', 'd7c8q'],
+].forEach(([fen, answer, moves], id) => {
+    test(`signature:${id}`, () => {
+        chess.load(fen, false);
+        if (moves)
+            chess.multiUci(moves);
+        expect(chess.signature()).toEqual(answer);
+    });
+});
+
+// seek
+[
+    [40, 0, 0],
+    [40, 37, 3],
+    [40, 33, 1],
+    [0, 15, 15],
+    [20, 18, 2],
+    [20, 25, 5],
+    [20, 40, 8],
+    [20, -1, -1],
+    [20, 41, -1],
+].forEach(([start, index, answer], id) => {
+    test(`seek:${id}`, () => {
+        let moves = [
+            'e4 e5 Nf3 Nc6 Bb5 a6 Ba4 Nf6 O-O Be7 Re1 b5 Bb3 d6 c3 O-O h3 Nb8 d4 Nbd7',
+            'c4 c6 cxb5 axb5 Nc3 Bb7 Bg5 b4 Nb1 h6 Bh4 c5 dxe5 Nxe4 Bxe7 Qxe7 exd6 Qf6 Nbd2 Nxd6',
+        ].join(' ').split(' ');
+        expect(seeker.reset('')).toEqual(0);
+        expect(seeker.add(moves.slice(0, 20).join(' '))).toEqual(20);
+        expect(seeker.add(moves.slice(20).join(' '))).toEqual(40);
+        seeker.seek(start);
+
+        let fen = seeker.seek(index);
+        expect(seeker.steps()).toEqual(Math.max(answer, 0));
+        if (answer < 0) {
+            expect(fen).toEqual('');
+            return;
+        }
+        chess.load(START_FEN, false);
+        for (let move of moves.slice(0, index))
+            chess.moveSan(move, false, false);
+        expect(fen).toEqual(chess.fen());
+    });
+});
+
+// seekAdd
+[
+    ['', 'e2e4 e7e5 g1f3', 3, 3, 'rnbqkbnr/pppp1ppp/8/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R b KQkq - 1 2'],
+    ['', '1. d4 d5 2. c4 e6?! 3. Zz4 Nc3', 0, 4, START_FEN],
+    [START_FEN, 'e4 e5 Nf3', 2, 3, 'rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2'],
+    ['', 'e5 e4', 0, 0, START_FEN],
+].forEach(([fen, multi, index, answer, answer_fen], id) => {
+    test(`seekAdd:${id}`, () => {
+        seeker.reset(fen);
+        expect(seeker.add(multi)).toEqual(answer);
+        chess.load(START_FEN, false);
+        expect(seeker.seek(index)).toEqual(answer_fen);
+    });
+});
+
 // squareToAn
 [
     [0, false, 'a8'],
@@ -1383,6 +2238,108 @@ beforeEach(() => {
     });
 });
 
+// storeQuery
+[
+    ['', [0, 1, 2, 3, 4, 5]],
+    ['eval>2', [1, 2]],
+    ['eval<0', []],
+    ['N@f3', [2]],
+    ['P@4', [0, 1, 2, 3, 4, 5]],
+    ['!P@e4', [3, 4, 5]],
+    ['B@f4,g5 game=6', [5]],
+    ['ply>=1 ply<2', [1, 4]],
+    ['p=8 P>=8', [0, 1, 2, 3, 4, 5]],
+    ['p!=8', []],
+    ['ocb', []],
+    ['KQRRBBNNPPPPPPPPkqrrbbnnpppppppp', [0, 1, 2, 3, 4, 5]],
+    ['x=1', -1],
+    ['P@e9', -1],
+].forEach(([query, answer], id) => {
+    test(`storeQuery:${id}`, () => {
+        store.reset();
+        expect(store.add([
+            '[Event "A"]\n\n1. e4 {wv=0.30} e5 {wv=2.50} 2. Nf3 {wv=2.10} *\n',
+            '[Event "B"]\n\n1. d4 d5 2. Bf4 *\n',
+        ].join('\n'), 5)).toEqual(2);
+        expect(Array.from(store.column('game'))).toEqual([5, 5, 5, 6, 6, 6]);
+        expect(Array.from(store.column('ply'))).toEqual([0, 1, 2, 0, 1, 2]);
+
+        let count = store.query(query, 0);
+        if (answer == -1)
+            expect(count).toEqual(-1);
+        else {
+            expect(count).toEqual(answer.length);
+            expect(Array.from(store.column(''))).toEqual(answer);
+        }
+    });
+});
+
+// trackPv
+[
+    [START_FEN, ['e2e4 e7e5 g1f3', 'e2e4 e7e5 g1f3 b8c6', 'e2e4 c7c5', 'e2e4 c7c5'], [[0, 3], [3, 1], [1, 1], [2, 0]]],
+    [START_FEN, ['d2d4 d7d5 c2c4 e9e5 g1f3', 'd2d4 d7d5 c2c4 e7e6'], [[0, 3], [3, 1]]],
+    ['rknrbqnb/pppppppp/8/8/8/8/PPPPPPPP/RKNRBQNB w DAda - 0 1', ['d2d4 g8f6 c1b3', '1. d2d4 g8f6 2. c1b3 c8b6 3. e2e4'], [[0, 3], [3, 2]]],
+].forEach(([fen, multis, answers], id) => {
+    test(`trackPv:${id}`, () => {
+        let prev = [];
+        multis.forEach((multi, step) => {
+            let delta = ArrayJS(chess.trackPv(fen, multi)),
+                prefix = chess.trackPrefix(),
+                full = prev.slice(0, prefix).concat(delta);
+            expect([prefix, delta.length]).toEqual(answers[step]);
+
+            chess.load(fen, false);
+            expect(full).toEqual(ArrayJS(chess.multiUci(multi)));
+            prev = full;
+        });
+    });
+});
+
+// treeAdd
+[
+    [
+        '', ['1. e4 e5 2. Nf3 Nc6', 'e7e5 g1f3 b8c6 f1b5', 'e7e5 g1f3 g8f6'], [0, 1, 1],
+        [4, 5, 6], [['e4', 'e5', 'Nf3', 'Nc6'], ['e4', 'e5', 'Nf3', 'Nc6', 'Bb5'], ['e4', 'e5', 'Nf3', 'Nf6']], 7,
+    ],
+    [
+        'r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1', ['O-O Ke7', 'e1g1 e8e7', 'e1h1 e8d7+'], [0, 0],
+        [2, 2, 3], [['O-O', 'Ke7'], ['O-O', 'Ke7'], ['O-O', 'Kd7']], 4,
+    ],
+    ['', ['e4 e5', 'Nf3 e4', 'e4 e5 Ke3'], [0, 0, 0], [2, 3, 2], [['e4', 'e5'], ['Nf3'], ['e4', 'e5']], 4],
+].forEach(([fen, lines, starts, answer, sans, size], id) => {
+    test(`treeAdd:${id}`, () => {
+        expect(tree.reset(fen)).toEqual(0);
+        let nodes = lines.map((line, i) => tree.add(starts[i], line));
+        expect(nodes).toEqual(answer);
+        expect(nodes.map(node => ArrayJS(tree.path(node)).map(child => tree.node(child).m))).toEqual(sans);
+        expect(tree.size()).toEqual(size);
+    });
+});
+
+// treeDelta
+[
+    [4, 7, 2, [['Nf6', 3], ['Nc3', 4]]],
+    [7, 4, 2, [['Nc6', 3], ['Bb5', 4]]],
+    [4, 4, 4, []],
+    [5, 1, 1, []],
+    [0, 7, 0, [['e5', 1], ['Nf3', 2], ['Nf6', 3], ['Nc3', 4]]],
+].forEach(([old_id, new_id, common, answer], id) => {
+    test(`treeDelta:${id}`, () => {
+        tree.reset('rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1');
+        expect(tree.add(0, 'e5 Nf3 Nc6')).toEqual(3);
+        expect(tree.add(3, 'Bb5')).toEqual(4);
+        expect(tree.add(0, 'e5 Nf3 Nc6 Bc4')).toEqual(5);
+        expect(tree.add(2, 'g8f6 b1c3')).toEqual(7);
+        expect(ArrayJS(tree.children(3))).toEqual([4, 5]);
+        expect(tree.parent(6)).toEqual(2);
+        expect(tree.fen(6)).toEqual('rnbqkb1r/pppp1ppp/5n2/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3');
+
+        let moves = ArrayJS(tree.delta(old_id, new_id));
+        expect(tree.common()).toEqual(common);
+        expect(moves.map(move => [move.m, move.ply])).toEqual(answer);
+    });
+});
+
 // turn
 [
     [START_FEN, '', 0],
@@ -1428,7 +2385,7 @@ beforeEach(() => {
 [
     [START_FEN, 'e4', 1, '', [1449171223, 2851721280]],
     [START_FEN, '', 1, '', [1449171223, 2851721280]],
-    [START_FEN, 'e4 e5', 1, 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1', [3016215727, 2857690465]],
+    [START_FEN, 'e4 e5', 1, 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1', [3016215727, 2033461789]],
     [START_FEN, 'e4 e5', 2, '', [1449171223, 2851721280]],
     ['r1bqkb1r/pppp1ppp/2n2n2/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4', 'O-O', 1, '', [2063398905, 2654829949]],
     ['r1bqk2r/ppppbppp/3n4/4R3/8/8/PPPP1PPP/RNBQ1BK1 b kq - 0 8', 'O-O', 1, '', [1272697903, 3887138050]],
@@ -1452,6 +2409,7 @@ beforeEach(() => {
     ],
     ['bq1b1k1r/p1pp1r2/1p6/3Pp1Q1/4p1pP/1N6/PPP2PK1/B2R3R b h h3 0 17', 'gxh3+', 1, '', [2152484851, 3605274865]],
     ['5k2/8/8/8/6pP/8/6K1/8 b - h3 0 17', 'gxh3+', 1, '', [1514358265, 2342289575]],
+    [START_FEN, Array(50).fill('Nf3 Nf6 Ng1 Ng8').join(' '), 200, '', [1449171223, 2851721280]],
 ].forEach(([fen, moves, steps, answer, hash], id) => {
     test(`undo:${id}`, () => {
         chess.load(fen, true);
@@ -1493,6 +2451,30 @@ beforeEach(() => {
     });
 });
 
+// unpackPosition
+[
+    [START_FEN, {}, START_FEN],
+    ['r3k2r/8/8/8/8/8/8/R3K2R b Kq - 7 1', {}, 'r3k2r/8/8/8/8/8/8/R3K2R b Kq - 7 1'],
+    [
+        'rnbqkbnr/pppp1ppp/8/4p3/3P4/8/PPP1PPPP/RNBQKBNR w KQkq e6 0 1', {},
+        'rnbqkbnr/pppp1ppp/8/4p3/3P4/8/PPP1PPPP/RNBQKBNR w KQkq e6 0 1',
+    ],
+    [START_FEN, {34: 116}, ''],
+    [START_FEN, {36: 119}, ''],
+].forEach(([fen, changes, answer], id) => {
+    test(`unpackPosition:${id}`, () => {
+        chess.load(fen, false);
+        let data = new Uint8Array(chess.packPosition());
+        Keys(changes).forEach(key => {
+            data[key] = changes[key];
+        });
+        chess.reset();
+        expect(chess.unpackPosition(data)).toEqual(!!answer);
+        if (answer)
+            expect(chess.fen()).toEqual(answer);
+    });
+});
+
 // version
 [
     '20201102',
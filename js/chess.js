@@ -434,7 +434,7 @@ var Chess = function(fen_) {
         pawns = U8(8).fill(EMPTY),
         pieces = [U8(16).fill(EMPTY), U8(16).fill(EMPTY)],
         ply = 0,
-        ply_states = Array(128).fill(0).map(_ => [0, 0, 0, 0, 0]),
+        ply_states = Array(128).fill(0).map(_ => [0, 0, 0, 0, 0]),   // grown in addState, kept across loads
         positions = I32(2),
         pv_mode = 1,
         prev_pv = [],
@@ -496,7 +496,9 @@ var Chess = function(fen_) {
      * @param {number} move
      */
     function addState(move) {
-        let state = ply_states[ply & 127];
+        let state = ply_states[ply];
+        if (!state)
+            state = ply_states[ply] = [0, 0, 0, 0, 0];
         state[0] = board_hash;
         state[1] = castling.slice();
         state[2] = ep_square;
@@ -831,7 +833,7 @@ var Chess = function(fen_) {
     function moveList() {
         let lines = [];
         for (let i = 0; i <= ply; i ++) {
-            let state = ply_states[i & 127];
+            let state = ply_states[i];
             lines.push(state? ucifyMove(state[3]): '???');
         }
         return lines.join(' ');
@@ -2399,7 +2401,7 @@ var Chess = function(fen_) {
         ply --;
 
         let move,
-            state = ply_states[ply & 127];
+            state = ply_states[ply];
         [
             board_hash,
             castling,
@@ -2550,6 +2552,7 @@ var Chess = function(fen_) {
     this.params = params;
     this.perft = perft;
     this.piece = text => PIECES[text] || 0;
+    this.plyHashes = () => ply_states.slice(0, ply).map(state => state[0]);
     this.print = print;
     this.prepare = prepareSearch;
     this.put = put;
@@ -1138,6 +1138,30 @@ beforeEach(() => {
     });
 });
 
+// plyHashes
+[
+    [START_FEN, 'e2e4 c7c5', 0],
+    [START_FEN, 'e2e4 c7c5', 40],
+    ['rnbqk2r/pppppppp/8/8/8/8/PPPPPPPP/RNBQK2R w KQkq - 0 1', 'e1g1 a7a5', 35],
+].forEach(([fen, multi, repeat], id) => {
+    test(`plyHashes:${id}`, () => {
+        chess.load(fen, true);
+        let hashes = [],
+            moves = (multi + ' b1c3 b8c6 c3b1 c6b8'.repeat(repeat)).split(' ');
+        for (let move of moves) {
+            hashes.push(chess.boardHash());
+            chess.moveUci(move, false);
+        }
+
+        // the history grows past 128 plies, each entry is the position before the move
+        expect(chess.plyHashes()).toEqual(hashes);
+
+        while (chess.undo());
+        expect(chess.boardHash()).toEqual(hashes[0]);
+        expect(chess.plyHashes()).toEqual([]);
+    });
+});
+
 // prepare
 [
     [